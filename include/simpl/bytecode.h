@@ -0,0 +1,162 @@
+#ifndef __simpl_bytecode_h__
+#define __simpl_bytecode_h__
+
+#include <simpl/detail/functional.h>
+#include <simpl/detail/shape.h>
+#include <simpl/expression.h>
+#include <simpl/statement.h>
+#include <simpl/value.h>
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace simpl
+{
+	class vm;
+
+	// Anything the compiler does not lower to bytecode is handed back to the
+	// tree walking visitors, so an evaluator has to implement both.
+	class tree_evaluator : public statement_visitor, public expression_visitor
+	{
+	public:
+		// an evaluator like this one for copy, a copy of its vm.
+		virtual std::unique_ptr<tree_evaluator> copy_for(vm &copy) const = 0;
+	};
+
+	enum class opcode : uint8_t
+	{
+		push,           // push constants[arg]
+		push_empty,     // push an empty value
+		pop,            // discard the top of the stack
+		mark,           // remember the current stack height
+		unwind,         // drop everything above the last mark
+		single,         // require exactly one value above the last mark
+		load,           // push the value of refs[arg]
+		store,          // assign the top of the stack to refs[arg]
+		load_local,     // push the value in frame slot arg
+		store_local,    // assign the top of the stack to frame slot arg
+		load_global,    // push the value of global arg
+		store_global,   // assign the top of the stack to global arg
+		declare,        // track the top of the stack as local names[arg]
+		add,
+		sub,
+		mult,
+		div,
+		eqeq,
+		neq,
+		lt,
+		lte,
+		gt,
+		gte,
+		jump,           // pc = arg
+		jump_false,     // pop, pc = arg if the value is false
+		and_jump,       // pc = arg if the top is false, otherwise pop it
+		or_jump,        // pc = arg if the top is true, otherwise pop it
+		call,           // call calls[arg] with everything above the last mark
+		tail_call,      // call, reusing the current frame when the callee is compiled; a ret follows
+		expand,         // replace the array on top with its values
+		pre_incr,       // ++refs[arg]
+		post_incr,      // refs[arg]++
+		pre_decr,       // --refs[arg]
+		post_decr,      // refs[arg]--
+		new_blob,       // push an empty blob
+		blob_init,      // pop into the blob below at key keys[arg]
+		new_array,      // push an empty array
+		array_init,     // pop everything above the last mark into the array below
+		enter_scope,
+		exit_scope,
+		ret,            // return the top, unwinding arg nested scopes first
+		yield,          // suspend the generator running this chunk, handing out the top
+		iter,           // replace the top with an iterator over it
+		iter_next,      // push the next value of the iterator on top, or pc = arg when it has none
+		def,            // register functions[arg]
+		eval,           // walk statements[arg] with the fallback evaluator
+		eval_expr,      // walk expressions[arg] with the fallback evaluator
+		end,            // end of a top level chunk
+	};
+
+	struct instruction
+	{
+		opcode op;
+		uint32_t arg;
+	};
+
+	// How the compiler resolved a variable reference.
+	enum class ref_kind : uint8_t
+	{
+		dynamic,    // looked up by name through every scope
+		local,      // a slot in the current frame
+		global,     // a slot in the vm's global table
+	};
+
+	struct var_ref
+	{
+		ref_kind kind;
+		uint32_t slot;
+		const identifier *id;
+		// for each element of the identifier's path, the frame slot of a
+		// variable used as an index or -1.
+		std::vector<int32_t> index_slots;
+		// the first of the chunk's member caches, one per path element.
+		uint32_t members;
+	};
+
+	struct call_site
+	{
+		const nary_expression *expr;
+	};
+
+	struct chunk;
+
+	struct function_proto
+	{
+		std::string id;
+		std::string name;
+		std::vector<std::string> arg_types;
+		std::shared_ptr<const chunk> body;
+		bool generator = false; // a call makes a generator over body.
+	};
+
+	// A flattened, compiled statement. The chunk keeps the statement it was
+	// compiled from alive; identifiers and call sites point back into it.
+	// Nothing in it changes once it's compiled, so vms in other threads can
+	// run it; each keeps its own caches for it, see chunk_caches.
+	struct chunk
+	{
+		std::vector<instruction> code;
+		std::vector<value_t> constants;
+		std::vector<detail::atom> keys; // blob literal keys, interned when compiled
+		std::vector<std::string> names;
+		std::vector<var_ref> refs;
+		std::vector<call_site> calls;
+		std::vector<statement *> statements;
+		std::vector<expression *> expressions;
+		std::vector<function_proto> functions;
+		uint32_t member_sites = 0;
+
+		// function bodies only.
+		std::vector<std::string> arguments;
+
+		std::shared_ptr<statement> owner;
+	};
+
+	using chunk_ptr = std::shared_ptr<const chunk>;
+
+	// What a vm has learned running a chunk: for each call site the
+	// functions it resolved to and for each member access where the
+	// member was.
+	struct chunk_caches
+	{
+		explicit chunk_caches(const chunk &c)
+			:calls(c.calls.size()), members(c.member_sites)
+		{
+		}
+
+		std::vector<detail::call_cache> calls;
+		std::vector<detail::member_cache> members;
+	};
+}
+
+#endif // __simpl_bytecode_h__
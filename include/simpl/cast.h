@@ -1,7 +1,10 @@
 #ifndef __simpl_cast_h__
 #define __simpl_cast_h__
 
+#include <algorithm>
+#include <sstream>
 #include <stdexcept>
+#include <vector>
 #include <simpl/value.h>
 
 namespace simpl
@@ -65,7 +68,7 @@ namespace simpl
     const T cast(const value_t &value)
     {
         cast_<T> ct;
-        std::visit(ct, value);
+        simpl::visit(ct, value);
         return ct.value;
     }
 
@@ -156,13 +159,19 @@ To to(const From &from)\
 
     CAST(std::string, blobref_t)
     {
+        // members are printed by name, whatever order they were added in.
+        std::vector<const std::pair<detail::atom, value_t> *> members;
+        for (const auto &i : from->values)
+            members.push_back(&i);
+        std::sort(members.begin(), members.end(), [](const auto *l, const auto *r) { return l->first.str() < r->first.str(); });
+
         std::stringstream ss;
         size_t count = 0;
-        size_t size = from->values.size();
+        size_t size = members.size();
         ss << "{ ";
-        for (const auto &i : from->values)
+        for (const auto *i : members)
         {
-            ss << i.first << " : " << cast<std::string>(i.second);
+            ss << i->first.str() << " : " << cast<std::string>(i->second);
             ++count;
             if (count != size)
                 ss << ", ";
@@ -0,0 +1,697 @@
+#ifndef __simpl_compiler_h__
+#define __simpl_compiler_h__
+
+#include <simpl/bytecode.h>
+#include <simpl/expression.h>
+#include <simpl/optimizer.h>
+#include <simpl/statement.h>
+#include <simpl/vm.h>
+
+#include <map>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+namespace simpl
+{
+	namespace detail
+	{
+		inline std::string to_simpl_type_string(vm &vm, const simpl::argument &a)
+		{
+			const auto &simpl_type = a.type;
+			auto type_str = simpl_type.has_value() ? detail::to_builtin_type_string(simpl_type.value()) : "any";
+			if (!type_str.has_value() && vm.has_type(simpl_type.value()))
+				type_str = vm.lookup_type(simpl_type.value())->name;
+			if (!type_str.has_value())
+				throw std::runtime_error(detail::format("unknown type '{0}'", (simpl_type.has_value() ? simpl_type.value() : "<t>")));
+			return type_str.value();
+		}
+
+		inline std::string format_name(vm& vm, const std::string &name, const std::vector<argument> &arguments)
+		{
+			std::stringstream ss;
+			ss << name << "(";
+			for (size_t i = 0; i < arguments.size(); ++i)
+			{
+				const auto type_str = to_simpl_type_string(vm, arguments[i]);
+				ss << type_str;
+				if (i != arguments.size() - 1)
+					ss << ",";
+			}
+			ss << ")";
+			return ss.str();
+		}
+
+		inline std::vector<std::string> to_arg_types(vm &vm, const std::vector<simpl::argument> &args)
+		{
+			std::vector<std::string> ret;
+			for (const simpl::argument &a : args)
+			{
+				ret.push_back(to_simpl_type_string(vm,a));
+			}
+			return ret;
+		}
+	}
+
+	/// <summary>
+	/// Lowers a statement into a chunk of bytecode for vm::execute. Anything
+	/// it doesn't know how to lower is left for the tree walker.
+	/// </summary>
+	class compiler : public statement_visitor, public expression_visitor
+	{
+	public:
+		compiler(simpl::vm &vm)
+			:vm_(vm), chunk_(nullptr), scopes_(0), depth_(0), known_(true), top_level_(true)
+		{
+		}
+
+		chunk_ptr compile(statement_ptr statement)
+		{
+			auto c = std::make_shared<chunk>();
+			c->owner = std::shared_ptr<simpl::statement>(std::move(statement));
+			chunk_ = c.get();
+			scopes_ = 0;
+			blocks_.clear();
+			depth_ = 0;
+			known_ = true;
+			top_level_ = true;
+			if (c->owner)
+				c->owner->evaluate(*this);
+			emit(opcode::end);
+			return c;
+		}
+
+	public:
+		virtual void visit(expr_statement &cs)
+		{
+			if (!cs.expr())
+				return;
+			discard(cs.expr());
+		}
+
+		virtual void visit(let_statement &cs)
+		{
+			if (cs.expr())
+			{
+				if (has_expansion(*cs.expr()))
+				{
+					emit(opcode::mark);
+					compile(cs.expr());
+					emit(opcode::single);
+				}
+				else
+					compile(cs.expr());
+			}
+			else
+			{
+				emit(opcode::push_empty);
+			}
+			local(cs.name());
+		}
+
+		virtual void visit(if_statement &is)
+		{
+			std::vector<size_t> exits;
+			for (auto if_stmt = &is; if_stmt != nullptr; if_stmt = if_stmt->next().get())
+			{
+				// a branch the optimizer has already decided.
+				if (const auto cond = detail::truth(if_stmt->cond()); cond.has_value())
+				{
+					if (cond.value())
+					{
+						scoped(if_stmt->statement());
+						break;
+					}
+					if (!if_stmt->next() && if_stmt->else_statement())
+						scoped(if_stmt->else_statement());
+					continue;
+				}
+
+				if (if_stmt->cond())
+					compile(if_stmt->cond());
+				else
+					emit(opcode::push_empty);
+				auto skip = emit(opcode::jump_false);
+				scoped(if_stmt->statement());
+
+				const bool last = if_stmt->next() == nullptr;
+				if (!last || if_stmt->else_statement())
+					exits.push_back(emit(opcode::jump));
+				patch(skip);
+
+				if (last && if_stmt->else_statement())
+					scoped(if_stmt->else_statement());
+			}
+			for (auto exit : exits)
+				patch(exit);
+		}
+
+		virtual void visit(def_statement &ds)
+		{
+			function_proto proto;
+			proto.id = detail::format_name(vm_, ds.name(), ds.arguments());
+			proto.name = ds.name();
+			proto.arg_types = detail::to_arg_types(vm_, ds.arguments());
+			proto.generator = ds.generator();
+
+			auto body = std::make_shared<chunk>();
+			body->owner = chunk_->owner;
+			for (const auto &arg : ds.arguments())
+				body->arguments.push_back(arg.name);
+
+			// the arguments are the first slots of the frame, the body shares
+			// their scope.
+			std::map<std::string, int32_t> args;
+			for (const auto &arg : ds.arguments())
+				args[arg.name] = static_cast<int32_t>(args.size());
+
+			auto outer = chunk_;
+			auto outer_scopes = scopes_;
+			auto outer_blocks = std::move(blocks_);
+			auto outer_depth = depth_;
+			auto outer_known = known_;
+			auto outer_top_level = top_level_;
+			chunk_ = body.get();
+			scopes_ = 0;
+			blocks_ = { std::move(args) };
+			depth_ = static_cast<uint32_t>(ds.arguments().size());
+			known_ = true;
+			top_level_ = false;
+			if (ds.body())
+				ds.body()->evaluate(*this);
+			// implicit return.
+			emit(opcode::push_empty);
+			emit(opcode::ret);
+			chunk_ = outer;
+			scopes_ = outer_scopes;
+			blocks_ = std::move(outer_blocks);
+			depth_ = outer_depth;
+			known_ = outer_known;
+			top_level_ = outer_top_level;
+
+			proto.body = body;
+			chunk_->functions.emplace_back(std::move(proto));
+			emit(opcode::def, chunk_->functions.size() - 1);
+		}
+
+		virtual void visit(return_statement &rs)
+		{
+			// a call in tail position may take over the returning frame, the
+			// ret after it is only reached when it can't.
+			auto tail = dynamic_cast<nary_expression *>(rs.expr().get());
+			if (!top_level_ && tail != nullptr && tail->op() == op_type::func)
+				call(*tail, opcode::tail_call);
+			else if (rs.expr())
+			{
+				if (has_expansion(*rs.expr()))
+				{
+					emit(opcode::mark);
+					compile(rs.expr());
+					emit(opcode::single);
+				}
+				else
+					compile(rs.expr());
+			}
+			else
+				emit(opcode::push_empty);
+			emit(opcode::ret, scopes_);
+		}
+
+		virtual void visit(while_statement &ws)
+		{
+			const auto top = here();
+			compile(ws.cond());
+			auto exit = emit(opcode::jump_false);
+			scoped(ws.block());
+			emit(opcode::jump, top);
+			patch(exit);
+		}
+
+		virtual void visit(for_statement &fs)
+		{
+			const auto outer = enter_block();
+			if (fs.init())
+				fs.init()->evaluate(*this);
+
+			const auto top = here();
+			size_t exit = 0;
+			if (fs.cond())
+			{
+				compile(fs.cond());
+				exit = emit(opcode::jump_false);
+			}
+			scoped(fs.block());
+			if (fs.incr())
+				discard(fs.incr());
+			emit(opcode::jump, top);
+			if (fs.cond())
+				patch(exit);
+			exit_block(outer);
+		}
+
+		// the iterator stays on top of the stack through the loop, a hidden
+		// local of its scope; each value is a local of the body's.
+		virtual void visit(for_in_statement &fs)
+		{
+			const auto outer = enter_block();
+			compile(fs.source());
+			emit(opcode::iter);
+			local("(iterator)");
+
+			const auto top = here();
+			const auto exit = emit(opcode::iter_next);
+			const auto body = enter_block();
+			local(fs.name());
+			if (fs.block())
+				fs.block()->evaluate(*this);
+			exit_block(body);
+			emit(opcode::jump, top);
+			patch(exit);
+			exit_block(outer);
+		}
+
+		virtual void visit(yield_statement &ys)
+		{
+			if (has_expansion(*ys.expr()))
+			{
+				emit(opcode::mark);
+				compile(ys.expr());
+				emit(opcode::single);
+			}
+			else
+				compile(ys.expr());
+			emit(opcode::yield);
+		}
+
+		virtual void visit(block_statement &bs)
+		{
+			for (const auto &stmt : bs.statements())
+			{
+				if (stmt)
+					stmt->evaluate(*this);
+			}
+		}
+
+		virtual void visit(object_definition_statement &os)
+		{
+			fallback(os);
+		}
+
+		virtual void visit(import_statement &is)
+		{
+			// an import below the global scope declares its globals as
+			// locals of the current scope; their slots can't be known.
+			if (!blocks_.empty())
+				known_ = false;
+			fallback(is);
+		}
+
+		virtual void visit(expression &ex)
+		{
+			const auto &value = ex.value();
+			if (std::holds_alternative<value_t>(value))
+				emit(opcode::push, constant(std::get<value_t>(value)));
+			else if (std::holds_alternative<expression_ptr>(value))
+				compile(std::get<expression_ptr>(value));
+			else if (std::holds_alternative<identifier>(value))
+				load(std::get<identifier>(value));
+			else
+				fallback(ex);
+		}
+
+		virtual void visit(nary_expression &cs)
+		{
+			const auto &exprs = cs.expressions();
+			switch (cs.op())
+			{
+			case op_type::add:
+				return binary(cs, opcode::add);
+			case op_type::sub:
+				return binary(cs, opcode::sub);
+			case op_type::mult:
+				return binary(cs, opcode::mult);
+			case op_type::div:
+				return binary(cs, opcode::div);
+			case op_type::eqeq:
+				return binary(cs, opcode::eqeq);
+			case op_type::neq:
+				return binary(cs, opcode::neq);
+			case op_type::lt:
+				return binary(cs, opcode::lt);
+			case op_type::lteq:
+				return binary(cs, opcode::lte);
+			case op_type::gt:
+				return binary(cs, opcode::gt);
+			case op_type::gteq:
+				return binary(cs, opcode::gte);
+			case op_type::log_and:
+				return logical(cs, opcode::and_jump);
+			case op_type::log_or:
+				return logical(cs, opcode::or_jump);
+			case op_type::eq:
+			{
+				if (exprs.size() != 2 || !is_identifier(exprs[1]))
+					return fallback(cs);
+				compile(exprs[0]);
+				store(std::get<identifier>(exprs[1]->value()));
+				return;
+			}
+			case op_type::func:
+				return call(cs, opcode::call);
+			case op_type::expand:
+			{
+				if (exprs.size() != 1)
+					return fallback(cs);
+				compile(exprs[0]);
+				emit(opcode::expand);
+				return;
+			}
+			case op_type::increment:
+				return step(cs, opcode::pre_incr, opcode::post_incr);
+			case op_type::decrement:
+				return step(cs, opcode::pre_decr, opcode::post_decr);
+			default:
+				return fallback(cs);
+			}
+		}
+
+		virtual void visit(new_blob_expression &ns)
+		{
+			emit(opcode::new_blob);
+			for (size_t i = 0; i < ns.initializers().size(); ++i)
+			{
+				if (ns.initializers()[i].expr)
+				{
+					compile(ns.initializers()[i].expr);
+					emit(opcode::blob_init, key(ns.keys()[i]));
+				}
+			}
+		}
+
+		virtual void visit(new_array_expression &nas)
+		{
+			emit(opcode::new_array);
+			for (const auto &expr : nas.expressions())
+			{
+				emit(opcode::mark);
+				compile(expr);
+				emit(opcode::array_init);
+			}
+		}
+
+		virtual void visit(new_object_expression &nos)
+		{
+			fallback(nos);
+		}
+
+		virtual void visit(function_address_expression &fae)
+		{
+			emit(opcode::push, constant(fae.name()));
+		}
+
+	private:
+		void compile(const expression_ptr &expr)
+		{
+			if (!expr)
+				throw std::logic_error("invalid expression");
+			expr->evaluate(*this);
+		}
+
+		// evaluates an expression for its side effects only.
+		void discard(const expression_ptr &expr)
+		{
+			if (has_expansion(*expr))
+			{
+				emit(opcode::mark);
+				compile(expr);
+				emit(opcode::unwind);
+			}
+			else
+			{
+				compile(expr);
+				emit(opcode::pop);
+			}
+		}
+
+		void scoped(const statement_ptr &stmt)
+		{
+			const auto outer = enter_block();
+			if (stmt)
+				stmt->evaluate(*this);
+			exit_block(outer);
+		}
+
+		// declares the top of the stack as name in the innermost scope.
+		void local(const std::string &id)
+		{
+			emit(opcode::declare, name(id));
+			if (blocks_.empty())
+				return; // a global, see resolve().
+			blocks_.back()[id] = known_ ? static_cast<int32_t>(depth_++) : -1;
+		}
+
+		struct block_state
+		{
+			uint32_t depth;
+			bool known;
+		};
+
+		block_state enter_block()
+		{
+			emit(opcode::enter_scope);
+			++scopes_;
+			blocks_.emplace_back();
+			return block_state{ depth_, known_ };
+		}
+
+		// the scope's locals are popped with it.
+		void exit_block(const block_state &outer)
+		{
+			emit(opcode::exit_scope);
+			--scopes_;
+			blocks_.pop_back();
+			depth_ = outer.depth;
+			known_ = outer.known;
+		}
+
+		// Resolves a name against the scopes open in the function being
+		// compiled. Anything declared outside of it stays dynamic, the caller's
+		// locals are visible to the callee. At the top level a name that isn't
+		// a local of the statement can only be a global.
+		var_ref resolve(const std::string &name)
+		{
+			for (auto block = blocks_.rbegin(); block != blocks_.rend(); ++block)
+			{
+				auto var = block->find(name);
+				if (var == block->end())
+					continue;
+				if (var->second < 0)
+					break;
+				return var_ref{ ref_kind::local, static_cast<uint32_t>(var->second), nullptr, {}, 0 };
+			}
+			if (top_level_)
+				return var_ref{ ref_kind::global, static_cast<uint32_t>(vm_.global_slot(name)), nullptr, {}, 0 };
+			return var_ref{ ref_kind::dynamic, 0, nullptr, {}, 0 };
+		}
+
+		void load(const identifier &id)
+		{
+			auto ref = resolve(id.name);
+			if (!id.path.empty() || ref.kind == ref_kind::dynamic)
+				emit(opcode::load, reference(id));
+			else if (ref.kind == ref_kind::local)
+				emit(opcode::load_local, ref.slot);
+			else
+				emit(opcode::load_global, ref.slot);
+		}
+
+		void store(const identifier &id)
+		{
+			auto ref = resolve(id.name);
+			if (!id.path.empty() || ref.kind == ref_kind::dynamic)
+				emit(opcode::store, reference(id));
+			else if (ref.kind == ref_kind::local)
+				emit(opcode::store_local, ref.slot);
+			else
+				emit(opcode::store_global, ref.slot);
+		}
+
+		void binary(nary_expression &cs, opcode op)
+		{
+			const auto &exprs = cs.expressions();
+			if (exprs.size() != 2)
+				return fallback(cs);
+			compile(exprs[1]);
+			compile(exprs[0]);
+			emit(op);
+		}
+
+		void logical(nary_expression &cs, opcode op)
+		{
+			const auto &exprs = cs.expressions();
+			if (exprs.size() != 2)
+				return fallback(cs);
+			compile(exprs[1]);
+			auto skip = emit(op);
+			compile(exprs[0]);
+			patch(skip);
+		}
+
+		// ++i keeps the identifier first, i++ keeps it second.
+		void step(nary_expression &cs, opcode pre, opcode post)
+		{
+			const auto &exprs = cs.expressions();
+			if (exprs.size() == 2 && is_identifier(exprs[0]))
+				emit(pre, reference(std::get<identifier>(exprs[0]->value())));
+			else if (exprs.size() == 2 && is_identifier(exprs[1]))
+				emit(post, reference(std::get<identifier>(exprs[1]->value())));
+			else
+				fallback(cs);
+		}
+
+		void fallback(statement &stmt)
+		{
+			chunk_->statements.push_back(&stmt);
+			emit(opcode::eval, chunk_->statements.size() - 1);
+		}
+
+		void fallback(expression &expr)
+		{
+			chunk_->expressions.push_back(&expr);
+			emit(opcode::eval_expr, chunk_->expressions.size() - 1);
+		}
+
+		static bool is_identifier(const expression_ptr &expr)
+		{
+			return expr && std::holds_alternative<identifier>(expr->value());
+		}
+
+		// true if the expression can leave more (or less) than one value on
+		// the stack, i.e. it expands an array somewhere other than inside
+		// a call or an array initializer.
+		static bool has_expansion(expression &expr)
+		{
+			if (auto nary = dynamic_cast<nary_expression *>(&expr))
+			{
+				if (nary->op() == op_type::expand)
+					return true;
+				if (nary->op() == op_type::func)
+					return false;
+				for (const auto &e : nary->expressions())
+				{
+					if (e && has_expansion(*e))
+						return true;
+				}
+				return false;
+			}
+			if (dynamic_cast<new_array_expression *>(&expr))
+				return false;
+			if (auto blob = dynamic_cast<new_blob_expression *>(&expr))
+				return has_expansion(blob->initializers());
+			if (auto object = dynamic_cast<new_object_expression *>(&expr))
+				return has_expansion(object->initializers());
+			if (std::holds_alternative<expression_ptr>(expr.value()))
+			{
+				const auto &inner = std::get<expression_ptr>(expr.value());
+				return inner && has_expansion(*inner);
+			}
+			return false;
+		}
+
+		static bool has_expansion(const initializer_list_t &inits)
+		{
+			for (const auto &init : inits)
+			{
+				if (init.expr && has_expansion(*init.expr))
+					return true;
+			}
+			return false;
+		}
+
+		void call(nary_expression &cs, opcode op)
+		{
+			emit(opcode::push_empty); // retval
+			emit(opcode::mark);
+			for (const auto &expr : cs.expressions())
+				compile(expr);
+			chunk_->calls.push_back(call_site{ &cs });
+			emit(op, chunk_->calls.size() - 1);
+		}
+
+		size_t emit(opcode op, size_t arg = 0)
+		{
+			chunk_->code.push_back(instruction{ op, static_cast<uint32_t>(arg) });
+			return chunk_->code.size() - 1;
+		}
+
+		size_t here() const
+		{
+			return chunk_->code.size();
+		}
+
+		void patch(size_t at)
+		{
+			chunk_->code[at].arg = static_cast<uint32_t>(here());
+		}
+
+		size_t constant(const value_t &v)
+		{
+			chunk_->constants.push_back(v);
+			return chunk_->constants.size() - 1;
+		}
+
+		size_t key(const detail::atom &k)
+		{
+			chunk_->keys.push_back(k);
+			return chunk_->keys.size() - 1;
+		}
+
+		size_t name(const std::string &n)
+		{
+			chunk_->names.push_back(n);
+			return chunk_->names.size() - 1;
+		}
+
+		size_t reference(const identifier &id)
+		{
+			auto ref = resolve(id.name);
+			ref.id = &id;
+			for (const auto &at : id.path)
+			{
+				int32_t slot = -1;
+				if (std::holds_alternative<std::string>(at))
+				{
+					const auto index = resolve(std::get<std::string>(at));
+					if (index.kind == ref_kind::local)
+						slot = static_cast<int32_t>(index.slot);
+				}
+				ref.index_slots.push_back(slot);
+			}
+			ref.members = chunk_->member_sites;
+			chunk_->member_sites += static_cast<uint32_t>(id.path.size());
+			chunk_->refs.emplace_back(std::move(ref));
+			return chunk_->refs.size() - 1;
+		}
+
+	private:
+		simpl::vm &vm_;
+		chunk *chunk_;
+		size_t scopes_; // scopes opened in the current function body.
+
+		// the names declared in each scope open in the function being
+		// compiled, with their frame slot or -1 if it isn't known.
+		std::vector<std::map<std::string, int32_t>> blocks_;
+		uint32_t depth_; // locals on the frame.
+		bool known_;
+		bool top_level_;
+	};
+
+	inline chunk_ptr compile(vm &vm, statement_ptr statement)
+	{
+		compiler c(vm);
+		return c.compile(std::move(statement));
+	}
+}
+
+#endif // __simpl_compiler_h__
@@ -0,0 +1,157 @@
+#ifndef __simpl_arena_h__
+#define __simpl_arena_h__
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <vector>
+
+namespace simpl
+{
+    namespace detail
+    {
+        // Storage for the syntax tree nodes of one parse. Nodes are bumped out
+        // of large blocks, each behind a header naming its arena, and the
+        // blocks are freed together when the last node and the parser are
+        // gone. A function body kept past its syntax tree keeps them alive.
+        class node_arena
+        {
+            static constexpr size_t Block_Size = 32 * 1024;
+            static constexpr size_t Align = alignof(std::max_align_t);
+
+            struct header
+            {
+                node_arena *owner;
+            };
+            static constexpr size_t Header_Size = (sizeof(header) + Align - 1) & ~(Align - 1);
+
+        public:
+            node_arena(const node_arena &) = delete;
+            node_arena &operator=(const node_arena &) = delete;
+
+            // the creator holds the first reference.
+            static node_arena *create()
+            {
+                return new node_arena();
+            }
+
+            void release()
+            {
+                if (refs_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                    delete this;
+            }
+
+            // from the arena current on this thread, or the heap.
+            static void *allocate(size_t size)
+            {
+                auto arena = current();
+                void *p = arena != nullptr ? arena->bump(Header_Size + size) : ::operator new(Header_Size + size);
+                new (p) header{ arena };
+                return static_cast<std::byte *>(p) + Header_Size;
+            }
+
+            static void deallocate(void *node)
+            {
+                if (node == nullptr)
+                    return;
+                auto p = static_cast<std::byte *>(node) - Header_Size;
+                auto owner = std::launder(reinterpret_cast<header *>(p))->owner;
+                if (owner == nullptr)
+                    ::operator delete(p);
+                else
+                    owner->release();
+            }
+
+            // the arena a node was allocated from, nullptr for the heap.
+            static const node_arena *owner(const void *node)
+            {
+                auto p = static_cast<const std::byte *>(node) - Header_Size;
+                return std::launder(reinterpret_cast<const header *>(p))->owner;
+            }
+
+            static node_arena *&current()
+            {
+                thread_local node_arena *arena = nullptr;
+                return arena;
+            }
+
+            // bytes taken from the heap for blocks.
+            size_t reserved() const
+            {
+                return reserved_;
+            }
+
+        private:
+            node_arena()
+                :used_(Block_Size), reserved_(0), refs_(1)
+            {
+            }
+
+            void *bump(size_t size)
+            {
+                size = (size + Align - 1) & ~(Align - 1);
+                refs_.fetch_add(1, std::memory_order_relaxed);
+                if (size > Block_Size)
+                {
+                    // an oversized node gets a block to itself, the current
+                    // block stays last.
+                    blocks_.emplace(blocks_.begin(), new std::byte[size]);
+                    reserved_ += size;
+                    return blocks_.front().get();
+                }
+                if (used_ + size > Block_Size)
+                {
+                    blocks_.emplace_back(new std::byte[Block_Size]);
+                    reserved_ += Block_Size;
+                    used_ = 0;
+                }
+                auto p = blocks_.back().get() + used_;
+                used_ += size;
+                return p;
+            }
+
+        private:
+            std::vector<std::unique_ptr<std::byte[]>> blocks_;
+            size_t used_;
+            size_t reserved_;
+            std::atomic<size_t> refs_;
+        };
+
+        struct arena_release
+        {
+            void operator()(node_arena *arena) const
+            {
+                arena->release();
+            }
+        };
+
+        // a reference held by whatever creates the arena.
+        using arena_ref = std::unique_ptr<node_arena, arena_release>;
+
+        // Makes an arena current on this thread while it's in scope.
+        class arena_scope
+        {
+        public:
+            explicit arena_scope(node_arena *arena)
+                :prev_(node_arena::current())
+            {
+                node_arena::current() = arena;
+            }
+
+            ~arena_scope()
+            {
+                node_arena::current() = prev_;
+            }
+
+            arena_scope(const arena_scope &) = delete;
+            arena_scope &operator=(const arena_scope &) = delete;
+
+        private:
+            node_arena *prev_;
+        };
+    }
+}
+
+#endif //__simpl_arena_h__
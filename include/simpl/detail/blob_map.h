@@ -0,0 +1,222 @@
+#ifndef __simpl_blob_map_h__
+#define __simpl_blob_map_h__
+
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace simpl
+{
+    namespace detail
+    {
+        // An interned key. The string lives as long as the process, so keys
+        // compare by address and carry their hash with them. Nothing is ever
+        // removed from the table: script literals intern their keys once,
+        // where they're parsed, but every distinct key a host adds to a blob
+        // stays interned, so keys made from data grow it without bound.
+        struct atom
+        {
+            const std::string *name;
+            size_t hash;
+
+            const std::string &str() const
+            {
+                return *name;
+            }
+
+            bool operator==(const atom &rhs) const
+            {
+                return name == rhs.name;
+            }
+
+            bool operator!=(const atom &rhs) const
+            {
+                return name != rhs.name;
+            }
+        };
+
+        class atoms
+        {
+        public:
+            static size_t hash(const std::string &name)
+            {
+                return std::hash<std::string>{}(name);
+            }
+
+            static atom intern(const std::string &name)
+            {
+                auto &r = instance();
+                std::lock_guard<std::mutex> lock(r.mutex_);
+                auto it = r.names_.insert(name).first;
+                return atom{ &*it, hash(name) };
+            }
+
+        private:
+            static atoms &instance()
+            {
+                static atoms a;
+                return a;
+            }
+
+        private:
+            std::mutex mutex_;
+            std::unordered_set<std::string> names_;
+        };
+
+        // The members of a blob. Entries are kept in insertion order and are
+        // never removed, so an entry keeps its index for the life of the map.
+        // Up to Inline_Keys entries are searched in place, past that an open
+        // addressing index of entry positions is kept beside them.
+        template <typename V>
+        class blob_map
+        {
+            static constexpr size_t Inline_Keys = 8;
+            static constexpr uint32_t Empty = 0;
+
+        public:
+            using value_type = std::pair<atom, V>;
+            using iterator = typename std::vector<value_type>::iterator;
+            using const_iterator = typename std::vector<value_type>::const_iterator;
+
+            static constexpr size_t npos = static_cast<size_t>(-1);
+
+            iterator begin() { return entries_.begin(); }
+            iterator end() { return entries_.end(); }
+            const_iterator begin() const { return entries_.begin(); }
+            const_iterator end() const { return entries_.end(); }
+
+            size_t size() const
+            {
+                return entries_.size();
+            }
+
+            bool empty() const
+            {
+                return entries_.empty();
+            }
+
+            // the position of key in insertion order or npos.
+            size_t index_of(const std::string &key) const
+            {
+                const auto h = atoms::hash(key);
+                return locate(h, [&](const atom &a) { return a.hash == h && a.str() == key; });
+            }
+
+            size_t index_of(const atom &key) const
+            {
+                return locate(key.hash, [&](const atom &a) { return a == key; });
+            }
+
+            iterator find(const std::string &key)
+            {
+                const auto i = index_of(key);
+                return i == npos ? end() : begin() + i;
+            }
+
+            const_iterator find(const std::string &key) const
+            {
+                const auto i = index_of(key);
+                return i == npos ? end() : begin() + i;
+            }
+
+            V &at(const std::string &key)
+            {
+                const auto i = index_of(key);
+                if (i == npos)
+                    throw std::out_of_range("blob has no member '" + key + "'");
+                return entries_[i].second;
+            }
+
+            const V &at(const std::string &key) const
+            {
+                const auto i = index_of(key);
+                if (i == npos)
+                    throw std::out_of_range("blob has no member '" + key + "'");
+                return entries_[i].second;
+            }
+
+            value_type &entry(size_t i)
+            {
+                return entries_[i];
+            }
+
+            // a key that isn't in the map yet is interned, see atom.
+            V &operator[](const std::string &key)
+            {
+                const auto i = index_of(key);
+                return i == npos ? insert(atoms::intern(key)) : entries_[i].second;
+            }
+
+            V &operator[](const atom &key)
+            {
+                const auto i = index_of(key);
+                return i == npos ? insert(key) : entries_[i].second;
+            }
+
+        private:
+            template <typename EqT>
+            size_t locate(size_t hash, EqT eq) const
+            {
+                if (index_.empty())
+                {
+                    for (size_t i = 0; i < entries_.size(); ++i)
+                    {
+                        if (eq(entries_[i].first))
+                            return i;
+                    }
+                    return npos;
+                }
+
+                const auto mask = index_.size() - 1;
+                for (auto pos = hash & mask; index_[pos] != Empty; pos = (pos + 1) & mask)
+                {
+                    const auto i = index_[pos] - 1;
+                    if (eq(entries_[i].first))
+                        return i;
+                }
+                return npos;
+            }
+
+            V &insert(const atom &key)
+            {
+                entries_.emplace_back(key, V{});
+                if (entries_.size() > Inline_Keys)
+                {
+                    // kept at most half full.
+                    if (entries_.size() * 2 > index_.size())
+                        rehash(index_.empty() ? Inline_Keys * 4 : index_.size() * 2);
+                    else
+                        place(entries_.size() - 1);
+                }
+                return entries_.back().second;
+            }
+
+            void rehash(size_t capacity)
+            {
+                index_.assign(capacity, Empty);
+                for (size_t i = 0; i < entries_.size(); ++i)
+                    place(i);
+            }
+
+            void place(size_t i)
+            {
+                const auto mask = index_.size() - 1;
+                auto pos = entries_[i].first.hash & mask;
+                while (index_[pos] != Empty)
+                    pos = (pos + 1) & mask;
+                index_[pos] = static_cast<uint32_t>(i + 1);
+            }
+
+        private:
+            std::vector<value_type> entries_;
+            std::vector<uint32_t> index_;
+        };
+    }
+}
+
+#endif //__simpl_blob_map_h__
@@ -2,13 +2,18 @@
 #define __simpl_functional_h__
 
 #include <simpl/detail/format.h>
+#include <simpl/detail/stats.h>
 #include <simpl/detail/types.h>
 
 #include <functional>
+#include <memory>
 #include <sstream>
 
 namespace simpl
 {
+    struct chunk;
+    class vm;
+
     namespace detail
     {
         inline std::string format_name(const std::string &name, const std::vector<std::string> &arguments)
@@ -36,27 +41,47 @@ namespace simpl
             std::string id;
             std::string name;
             std::vector<std::string> args;
-            std::function<void()> fn;
+            std::function<void(vm &)> fn; // called with the vm it runs in.
+            std::shared_ptr<const chunk> body; // compiled script functions only.
+            std::vector<size_t> arg_ids; // set when registered.
         };
 
         class dispatch_table
         {
         public:
             dispatch_table(type_table &types)
-                :types_(types)
+                :types_(types), entries_(std::make_shared<entries>())
+            {
+            }
+
+            // the functions of another table, resolved against types. The
+            // two share them until either registers another.
+            dispatch_table(type_table &types, const dispatch_table &rhs)
+                :types_(types), entries_(rhs.entries_), generation_(rhs.generation_)
             {
             }
 
+            dispatch_table(const dispatch_table &) = delete;
+            dispatch_table &operator=(const dispatch_table &) = delete;
+
             const fn_def *try_lookup(const call_def &cd)
             {
-                std::vector<std::string> args = cd.arguments;
-                const fn_def *match = find_exact_match(cd.name, args);
+                const auto args = to_ids(cd.arguments);
+                auto overloads = entries_->overloads.find(cd.name);
+                if (overloads == entries_->overloads.end())
+                    return nullptr;
+
+                const fn_def *match = find_exact_match(overloads->second, args);
 
                 if (match != nullptr)
+                {
+                    exact_lookups_.add();
                     return match;
+                }
 
                 // find all candidate functions w/ first arg in-tree
-                auto candidates = find_candidate_functions(cd.name, args);
+                candidate_lookups_.add();
+                auto candidates = find_candidate_functions(overloads->second, args);
 
                 if (candidates.size() != 1)
                     return nullptr;
@@ -65,22 +90,35 @@ namespace simpl
             }
 
             const fn_def *lookup(const call_def &cd)
+            {
+                return lookup(cd.name, to_ids(cd.arguments));
+            }
+
+            const fn_def *lookup(const std::string &name, const std::vector<size_t> &args)
             {
                 // 1. argument specific lookup.
                 // 2. backoff generic lookup.
-                std::vector<std::string> args = cd.arguments;
-                const fn_def *match = find_exact_match(cd.name, args);
+                std::vector<const fn_def *> candidates;
+                auto overloads = entries_->overloads.find(name);
+                if (overloads != entries_->overloads.end())
+                {
+                    const fn_def *match = find_exact_match(overloads->second, args);
 
-                if (match != nullptr)
-                    return match;
+                    if (match != nullptr)
+                    {
+                        exact_lookups_.add();
+                        return match;
+                    }
 
-                auto candidates = find_candidate_functions(cd.name, args);
+                    candidate_lookups_.add();
+                    candidates = find_candidate_functions(overloads->second, args);
+                }
 
                 if (candidates.size() > 1)
-                    throw std::runtime_error(detail::format("ambiguous function call: '{0}'", cd.name));
+                    throw std::runtime_error(detail::format("ambiguous function call: '{0}'", name));
 
                 if (candidates.size() == 0)
-                    throw std::runtime_error(detail::format("no matching function found: '{0}'", cd.name));
+                    throw std::runtime_error(detail::format("no matching function found: '{0}'", name));
 
                 return candidates[0];
             }
@@ -92,26 +130,53 @@ namespace simpl
             void register_function(fn_def &&df)
             {
                 auto name = df.id;
-                if (functions_.find(name) != functions_.end())
+                if (entries_->functions.find(name) != entries_->functions.end())
                 {
                     throw std::runtime_error(detail::format("function '{0}' already defined", name));
                 }
-                functions_[name] = std::move(df);
+                df.arg_ids = to_ids(df.args);
+                if (entries_.use_count() > 1)
+                    entries_ = std::make_shared<entries>(*entries_);
+                auto fn = std::make_shared<const fn_def>(std::move(df));
+                entries_->functions[name] = fn;
+                entries_->overloads[fn->name].push_back(fn.get());
+                ++generation_; // a new overload can change what a call resolves to.
+            }
+
+            size_t generation() const
+            {
+                return generation_;
+            }
 
+            uint64_t exact_lookups() const
+            {
+                return exact_lookups_.value();
+            }
+
+            uint64_t candidate_lookups() const
+            {
+                return candidate_lookups_.value();
             }
 
         private:
 
-            std::vector<const fn_def *> find_candidate_functions(const std::string &name, const std::vector<std::string> &args_t)
+            static std::vector<size_t> to_ids(const std::vector<std::string> &types)
+            {
+                std::vector<size_t> ids;
+                for (const auto &t : types)
+                    ids.push_back(type_ids::intern(t));
+                return ids;
+            }
+
+            std::vector<const fn_def *> find_candidate_functions(const std::vector<const fn_def *> &overloads, const std::vector<size_t> &args_t)
             {
                 // build the inheritance tree
                 std::vector<const fn_def *> candidates;
-                for (const auto &fn : functions_)
+                for (const auto fn : overloads)
                 {
-                    const auto &fn_d = fn.second;
-                    const auto &args = fn.second.args;
-                    if (fn_d.name == name && fn_d.args.size() == args_t.size() && (args_t.size() == 0 || types_.is_a(args_t[0], args[0])))
-                        candidates.push_back(&fn.second);
+                    const auto &args = fn->arg_ids;
+                    if (args.size() == args_t.size() && (args_t.size() == 0 || types_.is_a(args_t[0], args[0])))
+                        candidates.push_back(fn);
                 }
 
                 candidates.erase(std::remove_if(candidates.begin(), candidates.end(),
@@ -119,7 +184,7 @@ namespace simpl
                 {
                     for (size_t i = 1; i < args_t.size(); ++i)
                     {
-                        if (!types_.is_a(args_t[i], fn->args[i]))
+                        if (!types_.is_a(args_t[i], fn->arg_ids[i]))
                             return true;
                     }
                     return false;
@@ -129,18 +194,91 @@ namespace simpl
                 return candidates;
             }
 
-            const fn_def *find_exact_match(const std::string &name, const std::vector<std::string> &args)
+            const fn_def *find_exact_match(const std::vector<const fn_def *> &overloads, const std::vector<size_t> &args)
             {
-                auto call_id = detail::format_name(name, args);
-                auto match = functions_.find(call_id);
-                if (match == functions_.end())
-                    return nullptr;
-                return &match->second;
+                for (const auto fn : overloads)
+                {
+                    if (fn->arg_ids == args)
+                        return fn;
+                }
+                return nullptr;
             }
 
         private:
             type_table &types_;
-            std::map<std::string, fn_def> functions_;
+            // registered functions don't change, so tables copied from one
+            // another share them, and the maps too until one is added to.
+            struct entries
+            {
+                std::map<std::string, std::shared_ptr<const fn_def>> functions;
+                std::map<std::string, std::vector<const fn_def *>> overloads;
+            };
+            std::shared_ptr<entries> entries_;
+            size_t generation_ = 0;
+            counter exact_lookups_;
+            counter candidate_lookups_;
+        };
+
+        // A polymorphic inline cache for a single call site. It remembers
+        // the functions the last few argument type combinations resolved to,
+        // as long as nothing was registered with the table since.
+        class call_cache
+        {
+            struct entry
+            {
+                std::vector<size_t> types;
+                const fn_def *fn;
+            };
+
+        public:
+            static constexpr size_t Size = 4;
+
+            // ArgT(i) returns the i-th argument.
+            template <typename ArgT>
+            const fn_def *find(const dispatch_table &table, size_t arity, ArgT &&arg) const
+            {
+                if (table_ != &table || generation_ != table.generation())
+                    return nullptr;
+
+                for (const auto &e : entries_)
+                {
+                    if (e.types.size() != arity)
+                        continue;
+                    size_t i = 0;
+                    while (i < arity && e.types[i] == get_type_id(arg(i)))
+                        ++i;
+                    if (i == arity)
+                        return e.fn;
+                }
+                return nullptr;
+            }
+
+            template <typename ArgT>
+            void add(const dispatch_table &table, size_t arity, ArgT &&arg, const fn_def *fn)
+            {
+                if (table_ != &table || generation_ != table.generation())
+                {
+                    entries_.clear();
+                    next_ = 0;
+                    table_ = &table;
+                    generation_ = table.generation();
+                }
+
+                entry e{ {}, fn };
+                for (size_t i = 0; i < arity; ++i)
+                    e.types.push_back(get_type_id(arg(i)));
+
+                if (entries_.size() < Size)
+                    entries_.emplace_back(std::move(e));
+                else
+                    entries_[next_++ % Size] = std::move(e); // megamorphic, replace the oldest.
+            }
+
+        private:
+            std::vector<entry> entries_;
+            const dispatch_table *table_ = nullptr;
+            size_t generation_ = 0;
+            size_t next_ = 0;
         };
     }
 }
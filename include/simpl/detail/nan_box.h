@@ -0,0 +1,284 @@
+#ifndef __simpl_nan_box_h__
+#define __simpl_nan_box_h__
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <variant>
+
+namespace simpl
+{
+namespace detail
+{
+    // An 8 byte value cell, used as value_t when SIMPL_NAN_BOXING is defined.
+    //
+    // Numbers are stored as themselves. Everything else lives in the payload
+    // of a negative quiet NaN, with the alternative's index in bits 48-50.
+    // Strings and the reference types are kept in a refcounted heap cell, so
+    // copying a value never allocates. Strings are copied on write.
+    template <typename EmptyT, typename BlobRefT, typename ArrayRefT, typename ObjectRefT>
+    class nan_box
+    {
+        static constexpr uint64_t boxed = 0xFFF8000000000000ull;
+        static constexpr uint64_t payload = 0x0000FFFFFFFFFFFFull;
+        static constexpr uint64_t canonical_nan = 0x7FF8000000000000ull;
+
+        struct cell_base
+        {
+            std::atomic<uint32_t> refs{ 1 };
+        };
+
+        template <typename T>
+        struct cell : cell_base
+        {
+            template <typename U>
+            cell(U &&v)
+                :value(std::forward<U>(v))
+            {
+            }
+            T value;
+        };
+
+    public:
+        enum : size_t { empty_index, bool_index, number_index, string_index, blob_index, array_index, object_index };
+
+        nan_box()
+        {
+            set_tag(empty_index, 0);
+        }
+
+        nan_box(EmptyT)
+            :nan_box()
+        {
+        }
+
+        nan_box(bool b)
+        {
+            set_tag(bool_index, b ? 1 : 0);
+        }
+
+        nan_box(double d)
+        {
+            if (d != d)
+                bits_ = canonical_nan; // keep real NaNs out of the boxed range.
+            else
+                std::memcpy(&bits_, &d, sizeof(d));
+        }
+
+        nan_box(const std::string &s)
+        {
+            box<std::string>(string_index, s);
+        }
+
+        nan_box(std::string &&s)
+        {
+            box<std::string>(string_index, std::move(s));
+        }
+
+        nan_box(const char *s)
+            :nan_box(std::string{ s })
+        {
+        }
+
+        nan_box(const BlobRefT &b)
+        {
+            box<BlobRefT>(blob_index, b);
+        }
+
+        nan_box(const ArrayRefT &a)
+        {
+            box<ArrayRefT>(array_index, a);
+        }
+
+        template <typename T, typename = std::enable_if_t<std::is_convertible_v<std::shared_ptr<T>, ObjectRefT>>>
+        nan_box(const std::shared_ptr<T> &o)
+        {
+            box<ObjectRefT>(object_index, ObjectRefT{ o });
+        }
+
+        nan_box(const nan_box &rhs)
+            :bits_(rhs.bits_)
+        {
+            if (on_heap())
+                ++heap()->refs;
+        }
+
+        nan_box(nan_box &&rhs) noexcept
+            :bits_(rhs.bits_)
+        {
+            rhs.set_tag(empty_index, 0);
+        }
+
+        nan_box &operator=(const nan_box &rhs)
+        {
+            nan_box tmp(rhs);
+            std::swap(bits_, tmp.bits_);
+            return *this;
+        }
+
+        nan_box &operator=(nan_box &&rhs) noexcept
+        {
+            std::swap(bits_, rhs.bits_);
+            return *this;
+        }
+
+        ~nan_box()
+        {
+            release();
+        }
+
+        size_t index() const
+        {
+            if ((bits_ & boxed) != boxed)
+                return number_index;
+            return static_cast<size_t>((bits_ >> 48) & 0x7);
+        }
+
+        // bools and numbers live in the bits themselves, so they are read by
+        // value and written by assigning a value, which keeps NaNs canonical.
+        template <typename T>
+        static constexpr bool by_value = std::is_same_v<T, bool> || std::is_same_v<T, double>;
+
+        template <typename T>
+        using ref = std::conditional_t<by_value<T>, T, T &>;
+
+        template <typename T>
+        using const_ref = std::conditional_t<by_value<T>, T, const T &>;
+
+        template <typename T>
+        ref<T> get()
+        {
+            if constexpr (by_value<T>)
+                return std::as_const(*this).template get<T>();
+            else
+            {
+                check(index_of<T>());
+                if constexpr (std::is_same_v<T, EmptyT>)
+                    return empty_;
+                else
+                {
+                    if constexpr (std::is_same_v<T, std::string>)
+                        detach();
+                    return static_cast<cell<T> *>(heap())->value;
+                }
+            }
+        }
+
+        template <typename T>
+        const_ref<T> get() const
+        {
+            check(index_of<T>());
+            if constexpr (std::is_same_v<T, EmptyT>)
+                return empty_;
+            else if constexpr (std::is_same_v<T, bool>)
+                return (bits_ & 1) != 0; // the low bit of the payload.
+            else if constexpr (std::is_same_v<T, double>)
+            {
+                double d;
+                std::memcpy(&d, &bits_, sizeof(d));
+                return d;
+            }
+            else
+                return static_cast<const cell<T> *>(heap())->value;
+        }
+
+        template <typename T>
+        static constexpr size_t index_of()
+        {
+            if constexpr (std::is_same_v<T, EmptyT>) return empty_index;
+            else if constexpr (std::is_same_v<T, bool>) return bool_index;
+            else if constexpr (std::is_same_v<T, double>) return number_index;
+            else if constexpr (std::is_same_v<T, std::string>) return string_index;
+            else if constexpr (std::is_same_v<T, BlobRefT>) return blob_index;
+            else if constexpr (std::is_same_v<T, ArrayRefT>) return array_index;
+            else
+            {
+                static_assert(std::is_same_v<T, ObjectRefT>, "not a value type");
+                return object_index;
+            }
+        }
+
+    private:
+        bool on_heap() const
+        {
+            const auto i = index();
+            return i >= string_index && i <= object_index;
+        }
+
+        cell_base *heap() const
+        {
+            return reinterpret_cast<cell_base *>(static_cast<uintptr_t>(bits_ & payload));
+        }
+
+        void set_tag(size_t index, uint64_t value)
+        {
+            bits_ = boxed | (static_cast<uint64_t>(index) << 48) | (value & payload);
+        }
+
+        template <typename T, typename U>
+        void box(size_t index, U &&v)
+        {
+            auto c = new cell<T>(std::forward<U>(v));
+            const auto p = static_cast<uint64_t>(reinterpret_cast<uintptr_t>(static_cast<cell_base *>(c)));
+            if ((p & ~payload) != 0)
+            {
+                delete c;
+                throw std::runtime_error("pointer does not fit a boxed value");
+            }
+            set_tag(index, p);
+        }
+
+        void check(size_t index) const
+        {
+            if (this->index() != index)
+                throw std::bad_variant_access();
+        }
+
+        // strings are shared between copies until one of them is written.
+        void detach()
+        {
+            auto c = static_cast<cell<std::string> *>(heap());
+            if (c->refs.load() == 1)
+                return;
+            nan_box copy(std::string{ c->value });
+            std::swap(bits_, copy.bits_);
+        }
+
+        void release()
+        {
+            if (!on_heap())
+                return;
+            auto c = heap();
+            if (--c->refs != 0)
+                return;
+            switch (index())
+            {
+            case string_index:
+                delete static_cast<cell<std::string> *>(c);
+                break;
+            case blob_index:
+                delete static_cast<cell<BlobRefT> *>(c);
+                break;
+            case array_index:
+                delete static_cast<cell<ArrayRefT> *>(c);
+                break;
+            case object_index:
+                delete static_cast<cell<ObjectRefT> *>(c);
+                break;
+            }
+        }
+
+    private:
+        uint64_t bits_;
+        static inline EmptyT empty_{};
+    };
+}
+}
+
+#endif // __simpl_nan_box_h__
@@ -0,0 +1,171 @@
+#ifndef __simpl_scan_h__
+#define __simpl_scan_h__
+
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#define SIMPL_SCAN_AVX2
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define SIMPL_SCAN_SSE2
+#include <emmintrin.h>
+#endif
+
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#endif
+
+namespace simpl
+{
+    namespace detail
+    {
+        // Runs of bytes the tokenizer skips over, a block at a time where the
+        // target has SSE2 or AVX2 and a byte at a time for the rest. Each
+        // returns the first byte in [p, end) that ends the run, or end.
+        namespace scan
+        {
+            inline bool is_blank(char c)
+            {
+                return c == ' ' || c == '\t';
+            }
+
+            inline bool is_identifier(char c)
+            {
+                return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+            }
+
+#if defined(SIMPL_SCAN_AVX2) || defined(SIMPL_SCAN_SSE2)
+            inline unsigned first_set(uint32_t mask)
+            {
+#if defined(_MSC_VER) && !defined(__clang__)
+                unsigned long i;
+                _BitScanForward(&i, mask);
+                return static_cast<unsigned>(i);
+#else
+                return static_cast<unsigned>(__builtin_ctz(mask));
+#endif
+            }
+
+#if defined(SIMPL_SCAN_AVX2)
+            using block = __m256i;
+            constexpr ptrdiff_t width = 32;
+            constexpr uint32_t all = 0xFFFFFFFFu;
+
+            inline block load(const char *p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p)); }
+            inline block splat(char c) { return _mm256_set1_epi8(c); }
+            inline block eq(block l, block r) { return _mm256_cmpeq_epi8(l, r); }
+            inline block gt(block l, block r) { return _mm256_cmpgt_epi8(l, r); }
+            inline block either(block l, block r) { return _mm256_or_si256(l, r); }
+            inline block both(block l, block r) { return _mm256_and_si256(l, r); }
+            inline uint32_t bits(block b) { return static_cast<uint32_t>(_mm256_movemask_epi8(b)); }
+#else
+            using block = __m128i;
+            constexpr ptrdiff_t width = 16;
+            constexpr uint32_t all = 0xFFFFu;
+
+            inline block load(const char *p) { return _mm_loadu_si128(reinterpret_cast<const __m128i *>(p)); }
+            inline block splat(char c) { return _mm_set1_epi8(c); }
+            inline block eq(block l, block r) { return _mm_cmpeq_epi8(l, r); }
+            inline block gt(block l, block r) { return _mm_cmpgt_epi8(l, r); }
+            inline block either(block l, block r) { return _mm_or_si128(l, r); }
+            inline block both(block l, block r) { return _mm_and_si128(l, r); }
+            inline uint32_t bits(block b) { return static_cast<uint32_t>(_mm_movemask_epi8(b)); }
+#endif
+
+            // bytes in [lo, hi], both ascii so the signed compares hold.
+            inline block in_range(block v, char lo, char hi)
+            {
+                return both(gt(v, splat(lo - 1)), gt(splat(hi + 1), v));
+            }
+
+            // stop(block) gives a mask of the bytes that end the run.
+            template <typename BlockStopT, typename StopT>
+            inline const char *run(const char *p, const char *end, BlockStopT block_stop, StopT stop)
+            {
+                for (; end - p >= width; p += width)
+                {
+                    const auto mask = block_stop(load(p));
+                    if (mask != 0)
+                        return p + first_set(mask);
+                }
+                while (p != end && !stop(*p))
+                    ++p;
+                return p;
+            }
+
+            inline const char *skip_blanks(const char *p, const char *end)
+            {
+                return run(p, end, [](auto v)
+                {
+                    return ~bits(either(eq(v, splat(' ')), eq(v, splat('\t')))) & all;
+                }, [](char c) { return !is_blank(c); });
+            }
+
+            inline const char *skip_identifier(const char *p, const char *end)
+            {
+                return run(p, end, [](auto v)
+                {
+                    // setting 0x20 folds upper case onto lower and moves no
+                    // other byte into a-z.
+                    const auto alpha = in_range(either(v, splat(0x20)), 'a', 'z');
+                    const auto ident = either(either(alpha, in_range(v, '0', '9')), eq(v, splat('_')));
+                    return ~bits(ident) & all;
+                }, [](char c) { return !is_identifier(c); });
+            }
+
+            inline const char *find_eol(const char *p, const char *end)
+            {
+                return run(p, end, [](auto v)
+                {
+                    return bits(either(eq(v, splat('\n')), eq(v, splat('\r'))));
+                }, [](char c) { return c == '\n' || c == '\r'; });
+            }
+
+            inline const char *find(const char *p, const char *end, char c)
+            {
+                return run(p, end, [c](auto v)
+                {
+                    return bits(eq(v, splat(c)));
+                }, [c](char x) { return x == c; });
+            }
+#endif
+
+            // the same runs a unit at a time, for other character types or
+            // targets without SSE2.
+            template <typename CharT>
+            const CharT *skip_blanks(const CharT *p, const CharT *end)
+            {
+                while (p != end && (*p == ' ' || *p == '\t'))
+                    ++p;
+                return p;
+            }
+
+            template <typename CharT>
+            const CharT *skip_identifier(const CharT *p, const CharT *end)
+            {
+                while (p != end && *p < 0x80 && is_identifier(static_cast<char>(*p)))
+                    ++p;
+                return p;
+            }
+
+            template <typename CharT>
+            const CharT *find_eol(const CharT *p, const CharT *end)
+            {
+                while (p != end && *p != '\n' && *p != '\r')
+                    ++p;
+                return p;
+            }
+
+            template <typename CharT>
+            const CharT *find(const CharT *p, const CharT *end, CharT c)
+            {
+                while (p != end && *p != c)
+                    ++p;
+                return p;
+            }
+        }
+    }
+}
+
+#endif //__simpl_scan_h__
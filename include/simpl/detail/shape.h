@@ -0,0 +1,81 @@
+#ifndef __simpl_shape_h__
+#define __simpl_shape_h__
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace simpl
+{
+    namespace detail
+    {
+        // The layout of a script object, a member name to slot index. Objects
+        // of a type share its shape; adding a member moves an object to a
+        // child shape, which is made once and shared by every object that
+        // takes the same path.
+        class shape
+        {
+        public:
+            static constexpr size_t npos = static_cast<size_t>(-1);
+
+            shape() = default;
+            shape(const shape &) = delete;
+            shape &operator=(const shape &) = delete;
+
+            size_t slot(const std::string &name) const
+            {
+                auto i = slots_.find(name);
+                return i == slots_.end() ? npos : i->second;
+            }
+
+            size_t size() const
+            {
+                return names_.size();
+            }
+
+            const std::vector<std::string> &names() const
+            {
+                return names_;
+            }
+
+            // this shape with name added as the last slot.
+            std::shared_ptr<const shape> with(const std::string &name) const
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                auto &next = transitions_[name];
+                if (next == nullptr)
+                {
+                    next = std::make_shared<shape>();
+                    next->names_ = names_;
+                    next->slots_ = slots_;
+                    next->slots_.emplace(name, names_.size());
+                    next->names_.push_back(name);
+                }
+                return next;
+            }
+
+        private:
+            std::vector<std::string> names_;
+            std::unordered_map<std::string, size_t> slots_;
+
+            mutable std::mutex mtx_;
+            mutable std::map<std::string, std::shared_ptr<shape>> transitions_;
+        };
+
+        // The shape last seen at a member access site and the member's slot
+        // in it. Shapes live as long as the types that made them, so the
+        // pointer is only compared. For blobs it is the interned key found
+        // and its entry index instead.
+        struct member_cache
+        {
+            const shape *layout = nullptr;
+            const std::string *key = nullptr;
+            size_t slot = 0;
+        };
+    }
+}
+
+#endif //__simpl_shape_h__
@@ -0,0 +1,179 @@
+#ifndef __simpl_shared_string_h__
+#define __simpl_shared_string_h__
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <utility>
+
+namespace simpl
+{
+    namespace detail
+    {
+        // The string alternative of value_t. The text is immutable and shared
+        // by every copy, so copying one only counts a reference. The count,
+        // the hash once it's asked for and the text are one allocation; a
+        // short text sits in it, a long one has a buffer of its own. The
+        // empty string allocates nothing.
+        class shared_string
+        {
+            struct cell
+            {
+                template <typename ...Args>
+                explicit cell(Args &&...args)
+                    :text(std::forward<Args>(args)...)
+                {
+                }
+
+                std::atomic<uint32_t> refs{ 1 };
+                std::atomic<size_t> hash{ 0 }; // 0 until it's worked out.
+                std::string text;
+            };
+
+        public:
+            shared_string() = default;
+
+            shared_string(const std::string &s)
+                :cell_(s.empty() ? nullptr : new cell(s))
+            {
+            }
+
+            shared_string(std::string &&s)
+                :cell_(s.empty() ? nullptr : new cell(std::move(s)))
+            {
+            }
+
+            shared_string(const char *s)
+                :shared_string(std::string{ s })
+            {
+            }
+
+            shared_string(const shared_string &rhs) noexcept
+                :cell_(rhs.cell_)
+            {
+                if (cell_ != nullptr)
+                    cell_->refs.fetch_add(1, std::memory_order_relaxed);
+            }
+
+            shared_string(shared_string &&rhs) noexcept
+                :cell_(rhs.cell_)
+            {
+                rhs.cell_ = nullptr;
+            }
+
+            shared_string &operator=(const shared_string &rhs) noexcept
+            {
+                shared_string tmp(rhs);
+                std::swap(cell_, tmp.cell_);
+                return *this;
+            }
+
+            shared_string &operator=(shared_string &&rhs) noexcept
+            {
+                std::swap(cell_, rhs.cell_);
+                return *this;
+            }
+
+            ~shared_string()
+            {
+                release();
+            }
+
+            const std::string &str() const
+            {
+                return cell_ != nullptr ? cell_->text : empty();
+            }
+
+            size_t size() const
+            {
+                return str().size();
+            }
+
+            size_t hash() const
+            {
+                if (cell_ == nullptr)
+                    return std::hash<std::string>{}(empty());
+                auto h = cell_->hash.load(std::memory_order_relaxed);
+                if (h == 0)
+                {
+                    h = std::hash<std::string>{}(cell_->text);
+                    cell_->hash.store(h, std::memory_order_relaxed);
+                }
+                return h;
+            }
+
+            // The text to change, copied first if it's shared. The reference
+            // is good until the string is next copied or hashed.
+            std::string &mutate()
+            {
+                if (cell_ == nullptr)
+                    cell_ = new cell();
+                else if (cell_->refs.load(std::memory_order_acquire) != 1)
+                {
+                    auto own = new cell(cell_->text);
+                    release();
+                    cell_ = own;
+                }
+                cell_->hash.store(0, std::memory_order_relaxed);
+                return cell_->text;
+            }
+
+            // the same text, without reading it when they share it or their
+            // hashes are known and differ.
+            bool operator==(const shared_string &rhs) const
+            {
+                if (cell_ == rhs.cell_)
+                    return true;
+                if (size() != rhs.size())
+                    return false;
+                if (cell_ != nullptr && rhs.cell_ != nullptr)
+                {
+                    const auto l = cell_->hash.load(std::memory_order_relaxed);
+                    const auto r = rhs.cell_->hash.load(std::memory_order_relaxed);
+                    if (l != 0 && r != 0 && l != r)
+                        return false;
+                }
+                return str() == rhs.str();
+            }
+
+            bool operator!=(const shared_string &rhs) const
+            {
+                return !(*this == rhs);
+            }
+
+            bool operator<(const shared_string &rhs) const
+            {
+                return str() < rhs.str();
+            }
+
+        private:
+            static const std::string &empty()
+            {
+                static const std::string e;
+                return e;
+            }
+
+            void release()
+            {
+                if (cell_ != nullptr && cell_->refs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+                    delete cell_;
+                cell_ = nullptr;
+            }
+
+            cell *cell_ = nullptr;
+        };
+    }
+}
+
+template <>
+struct std::hash<simpl::detail::shared_string>
+{
+    size_t operator()(const simpl::detail::shared_string &s) const
+    {
+        return s.hash();
+    }
+};
+
+#endif // __simpl_shared_string_h__
@@ -28,6 +28,10 @@ namespace simpl
 
             using types = typename decay_tuple<Args...>::type;
 
+            // what each argument is bound as: a reference parameter as
+            // itself, one taken by value as const since it's copied anyway.
+            using bindings = std::tuple<std::conditional_t<std::is_reference_v<Args>, std::remove_reference_t<Args>, const Args>...>;
+
             std::string arguments_string() const
             {
                 return to_string<Args...>::types();
@@ -0,0 +1,110 @@
+#ifndef __simpl_stats_h__
+#define __simpl_stats_h__
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+
+namespace simpl
+{
+    namespace detail
+    {
+        // Counts only in builds with SIMPL_STATS defined; otherwise adding is
+        // nothing and it always reads 0. A copy starts over, so a copied vm
+        // counts its own work.
+#ifdef SIMPL_STATS
+        class counter
+        {
+        public:
+            counter() = default;
+            counter(const counter &) {}
+            counter &operator=(const counter &) { return *this; }
+
+            void add(uint64_t n = 1)
+            {
+                n_ += n;
+            }
+
+            uint64_t value() const
+            {
+                return n_;
+            }
+
+        private:
+            uint64_t n_ = 0;
+        };
+
+        class stopwatch
+        {
+        public:
+            stopwatch()
+                :start_(std::chrono::steady_clock::now())
+            {
+            }
+
+            uint64_t elapsed_ns() const
+            {
+                return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start_).count();
+            }
+
+        private:
+            std::chrono::steady_clock::time_point start_;
+        };
+#else
+        class counter
+        {
+        public:
+            void add(uint64_t = 1) {}
+            uint64_t value() const { return 0; }
+        };
+
+        class stopwatch
+        {
+        public:
+            uint64_t elapsed_ns() const { return 0; }
+        };
+#endif
+
+        // the counts a vm keeps itself, the dispatch and type tables keep theirs.
+        struct vm_counters
+        {
+            counter calls;
+            counter pushes;
+            counter pops;
+            counter blobs;
+            counter arrays;
+            counter objects;
+            counter imports;
+            counter import_ns;
+        };
+    }
+
+    /// <summary>
+    /// What a vm has done since it was made, see vm::stats. The counts are
+    /// only kept when built with SIMPL_STATS and read 0 otherwise; the high
+    /// water marks are always there.
+    /// </summary>
+    struct vm_stats
+    {
+#ifdef SIMPL_STATS
+        static constexpr bool enabled = true;
+#else
+        static constexpr bool enabled = false;
+#endif
+        uint64_t calls = 0;
+        uint64_t exact_lookups = 0;     // resolved by an overload taking exactly the arguments' types
+        uint64_t candidate_lookups = 0; // resolved by scanning the overloads for base types
+        uint64_t is_a_checks = 0;
+        uint64_t blobs = 0;
+        uint64_t arrays = 0;
+        uint64_t objects = 0;
+        uint64_t pushes = 0;            // through push_stack and pop_stack
+        uint64_t pops = 0;
+        uint64_t imports = 0;
+        std::chrono::nanoseconds import_time{ 0 };
+        size_t stack_high_water = 0;
+        size_t scope_high_water = 0;
+    };
+}
+
+#endif // __simpl_stats_h__
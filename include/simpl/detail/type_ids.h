@@ -0,0 +1,79 @@
+#ifndef __simpl_type_ids_h__
+#define __simpl_type_ids_h__
+
+#include <deque>
+#include <map>
+#include <mutex>
+#include <string>
+
+namespace simpl
+{
+namespace detail
+{
+    // Process wide, dense ids for type names. The builtin types are seeded
+    // so that their ids match the alternatives of value_t.
+    class type_ids
+    {
+    public:
+        static constexpr size_t empty = 0;
+        static constexpr size_t boolean = 1;
+        static constexpr size_t number = 2;
+        static constexpr size_t string = 3;
+        static constexpr size_t blob = 4;
+        static constexpr size_t array = 5;
+        static constexpr size_t any = 6;
+        static constexpr size_t npos = static_cast<size_t>(-1);
+
+        static size_t intern(const std::string &name)
+        {
+            auto &r = instance();
+            std::lock_guard<std::mutex> lock(r.mutex_);
+            auto found = r.ids_.find(name);
+            if (found != r.ids_.end())
+                return found->second;
+            r.names_.push_back(name);
+            r.ids_[name] = r.names_.size() - 1;
+            return r.names_.size() - 1;
+        }
+
+        // npos if the name was never interned.
+        static size_t find(const std::string &name)
+        {
+            auto &r = instance();
+            std::lock_guard<std::mutex> lock(r.mutex_);
+            auto found = r.ids_.find(name);
+            return found == r.ids_.end() ? npos : found->second;
+        }
+
+        static std::string name(size_t id)
+        {
+            auto &r = instance();
+            std::lock_guard<std::mutex> lock(r.mutex_);
+            return id < r.names_.size() ? r.names_[id] : std::string{ "<unknown>" };
+        }
+
+    private:
+        type_ids()
+        {
+            for (auto name : { "empty", "bool", "number", "string", "blob", "array", "any" })
+            {
+                names_.push_back(name);
+                ids_[name] = names_.size() - 1;
+            }
+        }
+
+        static type_ids &instance()
+        {
+            static type_ids ids;
+            return ids;
+        }
+
+    private:
+        std::mutex mutex_;
+        std::deque<std::string> names_;
+        std::map<std::string, size_t> ids_;
+    };
+}
+}
+
+#endif // __simpl_type_ids_h__
@@ -2,10 +2,15 @@
 #define __simpl_types_h__
 
 #include <simpl/detail/format.h>
+#include <simpl/detail/shape.h>
+#include <simpl/detail/stats.h>
+#include <simpl/detail/type_ids.h>
 #include <simpl/expression.h>
 
 #include <array>
-#include <list>
+#include <map>
+#include <memory>
+#include <vector>
 
 namespace simpl
 {
@@ -39,7 +44,8 @@ namespace simpl
             }
 
             type_def(type_def &&td) noexcept
-                :name(std::move(td.name)), native(std::move(td.native)), inherits(std::move(td.inherits)), members(std::move(td.members))
+                :name(std::move(td.name)), native(std::move(td.native)), inherits(std::move(td.inherits)), members(std::move(td.members)),
+                id(td.id), lineage(std::move(td.lineage)), layout(std::move(td.layout)), initializers(std::move(td.initializers))
             {
             }
 
@@ -49,6 +55,10 @@ namespace simpl
                 std::swap(td.native, native);
                 std::swap(td.inherits, inherits);
                 std::swap(td.members, members);
+                std::swap(td.id, id);
+                std::swap(td.lineage, lineage);
+                std::swap(td.layout, layout);
+                std::swap(td.initializers, initializers);
                 return *this;
             }
 
@@ -56,12 +66,25 @@ namespace simpl
             std::optional<std::string> native;
             const type_def *inherits;
             std::vector<simpl::object_definition::member> members;
+
+            // set when registered; the ids of the root type down to this one.
+            size_t id = type_ids::npos;
+            std::vector<size_t> lineage;
+
+            // set when registered; the layout of its objects and the member
+            // initializers to run on new, root type first.
+            std::shared_ptr<const shape> layout;
+            std::vector<std::pair<size_t, expression *>> initializers;
         };
 
+        // Registered types don't change, so copies of a table share them.
         class type_table
         {
 
         public:
+            type_table() = default;
+            type_table(const type_table &) = default;
+            type_table &operator=(const type_table &) = delete;
 
             void register_type(const std::string &name, const std::optional<std::string> &inherits, std::vector<object_definition::member> &&members)
             {
@@ -82,19 +105,29 @@ namespace simpl
                 if (t != nullptr)
                     throw std::runtime_error("type exists");
 
-                types_.emplace_back(std::move(def));
+                def.id = type_ids::intern(def.name);
+                if (def.inherits != nullptr)
+                    def.lineage = def.inherits->lineage;
+                def.lineage.push_back(def.id);
+                lay_out(def);
+
+                auto registered = std::make_shared<const type_def>(std::move(def));
+                types_.push_back(registered);
+                if (by_id_.size() <= registered->id)
+                    by_id_.resize(registered->id + 1, nullptr);
+                by_id_[registered->id] = registered.get();
                 
                 ++next_;
             }
 
             const type_def *get_type(const std::string &name)
             {
-                for (const auto &t : types_)
-                {
-                    if (t.name == name)
-                        return &t;
-                }
-                return nullptr;
+                return get_type(type_ids::find(name));
+            }
+
+            const type_def *get_type(size_t id) const
+            {
+                return id < by_id_.size() ? by_id_[id] : nullptr;
             }
 
             // checks if t1, is in the lineage of t2
@@ -103,39 +136,39 @@ namespace simpl
             // bike is-a car     -> false
             bool is_a(const std::string &t1, const std::string &t2)
             {
-                // first, find t1
-                // then walk its lineage until you find t2
-                const type_def *t1_p = nullptr;
-                for (const auto &td : types_)
-                {
-                    if (td.name == t1)
-                        t1_p = &td;
-                }
+                const auto t1_p = get_type(t1);
                 if (t1_p == nullptr)
                     throw std::runtime_error(detail::format("unrecognized type '{0}'", t1));
+                return is_a(t1_p->id, type_ids::find(t2));
+            }
 
-                if (t2 == "any")
-                    return true; // this is a hack...
+            // t2 is in t1's lineage if it sits at the same depth from the root.
+            bool is_a(size_t t1, size_t t2) const
+            {
+                is_a_checks_.add();
+                const auto t1_p = get_type(t1);
+                if (t1_p == nullptr)
+                    throw std::runtime_error(detail::format("unrecognized type '{0}'", type_ids::name(t1)));
 
-                while (t1_p != nullptr)
-                {
-                    if (t1_p->name == t2)
-                        return true;
-                    t1_p = t1_p->inherits;
-                }
-                return false;
+                if (t2 == type_ids::any)
+                    return true; // this is a hack...
 
+                const auto t2_p = get_type(t2);
+                if (t2_p == nullptr)
+                    return false;
+                const auto depth = t2_p->lineage.size() - 1;
+                return depth < t1_p->lineage.size() && t1_p->lineage[depth] == t2;
             }
 
             std::string translate_type(const std::string &nt)
             {
                 auto i = std::find_if(types_.begin(), types_.end(), [&](const auto &td)
                 {
-                    return td.native == nt;
+                    return td->native == nt;
                 });
                 if (i == types_.end())
                     throw std::runtime_error(detail::format("type '{0}' not registered", nt));
-                return i->name;
+                return (*i)->name;
             }
 
             std::vector<std::string> translate_types(const std::vector<std::string> &native_types)
@@ -148,9 +181,44 @@ namespace simpl
                 return simpl_types;
             }
 
+            uint64_t is_a_checks() const
+            {
+                return is_a_checks_.value();
+            }
+
+        private:
+            // a type's members follow its parent's, a redeclared member keeps
+            // the parent's slot and only adds its initializer.
+            void lay_out(type_def &def)
+            {
+                def.layout = def.inherits != nullptr ? def.inherits->layout : root_;
+                if (def.inherits != nullptr)
+                    def.initializers = def.inherits->initializers;
+
+                for (const auto &mi : def.members)
+                {
+                    auto slot = def.layout->slot(mi.name);
+                    if (slot == shape::npos)
+                    {
+                        def.layout = def.layout->with(mi.name);
+                        slot = def.layout->slot(mi.name);
+                    }
+                    else if (mi.initializer == nullptr)
+                    {
+                        throw std::runtime_error(detail::format("redfinition of member '{0}' in type '{1}'", mi.name, def.name));
+                    }
+
+                    if (mi.initializer)
+                        def.initializers.emplace_back(slot, mi.initializer.get());
+                }
+            }
+
         private:
-            std::list<detail::type_def> types_;
+            std::shared_ptr<const shape> root_ = std::make_shared<shape>();
+            std::vector<std::shared_ptr<const detail::type_def>> types_;
+            std::vector<const detail::type_def *> by_id_;
             size_t next_ = 0;
+            mutable counter is_a_checks_;
         };
     }
 }
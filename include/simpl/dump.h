@@ -0,0 +1,365 @@
+#ifndef __simpl_dump_h__
+#define __simpl_dump_h__
+
+#include <simpl/cast.h>
+#include <simpl/expression.h>
+#include <simpl/statement.h>
+#include <simpl/value.h>
+
+#include <ostream>
+#include <sstream>
+#include <string>
+
+namespace simpl
+{
+	namespace detail
+	{
+		inline const char *to_op_string(op_type op)
+		{
+			switch (op)
+			{
+			case op_type::add: return "+";
+			case op_type::sub: return "-";
+			case op_type::mult: return "*";
+			case op_type::div: return "/";
+			case op_type::mod: return "%";
+			case op_type::eq: return "=";
+			case op_type::eqeq: return "==";
+			case op_type::neq: return "!=";
+			case op_type::exp: return "^";
+			case op_type::gt: return ">";
+			case op_type::lt: return "<";
+			case op_type::gteq: return ">=";
+			case op_type::lteq: return "<=";
+			case op_type::log_and: return "&&";
+			case op_type::log_or: return "||";
+			case op_type::func: return "call";
+			case op_type::expand: return "...";
+			case op_type::bin_and: return "&";
+			case op_type::bin_or: return "|";
+			case op_type::increment: return "++";
+			case op_type::decrement: return "--";
+			default: return "?";
+			}
+		}
+	}
+
+	/// <summary>
+	/// Prints a syntax tree as s-expressions, one statement per line, e.g.
+	/// (let x 6) or (if (< i 10) ...). Binary operands are printed left
+	/// then right.
+	/// </summary>
+	class ast_printer : public statement_visitor, public expression_visitor
+	{
+	public:
+		ast_printer(std::ostream &os)
+			:os_(os), depth_(0), first_(true)
+		{
+		}
+
+		void print(const statement_ptr &stmt)
+		{
+			if (stmt)
+				stmt->evaluate(*this);
+		}
+
+		void print(const expression_ptr &expr)
+		{
+			if (expr)
+				expr->evaluate(*this);
+			else
+				os_ << "()";
+		}
+
+	public:
+		virtual void visit(expr_statement &cs)
+		{
+			open("expr");
+			inline_(cs.expr());
+			close();
+		}
+
+		virtual void visit(let_statement &cs)
+		{
+			open("let " + cs.name());
+			if (cs.expr())
+				inline_(cs.expr());
+			close();
+		}
+
+		virtual void visit(if_statement &is)
+		{
+			open("if");
+			inline_(is.cond());
+			child(is.statement());
+			auto if_stmt = &is;
+			for (; if_stmt->next(); if_stmt = if_stmt->next().get())
+			{
+				++depth_;
+				open("elif");
+				inline_(if_stmt->next()->cond());
+				child(if_stmt->next()->statement());
+				close();
+				--depth_;
+			}
+			if (if_stmt->else_statement())
+			{
+				++depth_;
+				open("else");
+				child(if_stmt->else_statement());
+				close();
+				--depth_;
+			}
+			close();
+		}
+
+		virtual void visit(def_statement &ds)
+		{
+			std::string head = "def " + ds.name() + "(";
+			for (size_t i = 0; i < ds.arguments().size(); ++i)
+			{
+				const auto &arg = ds.arguments()[i];
+				head += arg.name;
+				if (arg.type.has_value())
+					head += " is " + arg.type.value();
+				if (i != ds.arguments().size() - 1)
+					head += ",";
+			}
+			open(head + ")" + (ds.generator() ? " generator" : ""));
+			child(ds.body());
+			close();
+		}
+
+		virtual void visit(return_statement &rs)
+		{
+			open("return");
+			if (rs.expr())
+				inline_(rs.expr());
+			close();
+		}
+
+		virtual void visit(while_statement &ws)
+		{
+			open("while");
+			inline_(ws.cond());
+			child(ws.block());
+			close();
+		}
+
+		virtual void visit(for_statement &fs)
+		{
+			open("for");
+			inline_(fs.cond());
+			inline_(fs.incr());
+			child(fs.init());
+			child(fs.block());
+			close();
+		}
+
+		virtual void visit(for_in_statement &fs)
+		{
+			open("for " + fs.name() + " in");
+			inline_(fs.source());
+			child(fs.block());
+			close();
+		}
+
+		virtual void visit(yield_statement &ys)
+		{
+			open("yield");
+			inline_(ys.expr());
+			close();
+		}
+
+		virtual void visit(block_statement &bs)
+		{
+			open("block");
+			for (const auto &stmt : bs.statements())
+				child(stmt);
+			close();
+		}
+
+		virtual void visit(object_definition_statement &os)
+		{
+			open("object " + os.type_name() + (os.inherits().has_value() ? " inherits " + os.inherits().value() : ""));
+			++depth_;
+			for (const auto &member : os.members())
+			{
+				open(member.name);
+				if (member.initializer)
+					inline_(member.initializer);
+				close();
+			}
+			--depth_;
+			close();
+		}
+
+		virtual void visit(import_statement &is)
+		{
+			open("import " + is.libname());
+			close();
+		}
+
+		virtual void visit(expression &ex)
+		{
+			const auto &value = ex.value();
+			if (std::holds_alternative<value_t>(value))
+				literal(std::get<value_t>(value));
+			else if (std::holds_alternative<expression_ptr>(value))
+				print(std::get<expression_ptr>(value));
+			else if (std::holds_alternative<identifier>(value))
+				name(std::get<identifier>(value));
+			else
+				os_ << "()";
+		}
+
+		virtual void visit(nary_expression &cs)
+		{
+			const auto &exprs = cs.expressions();
+			os_ << "(" << detail::to_op_string(cs.op());
+			switch (cs.op())
+			{
+			case op_type::func:
+				os_ << " " << cs.identifier().name;
+				for (const auto &expr : exprs)
+					inline_(expr);
+				break;
+			case op_type::increment:
+			case op_type::decrement:
+				// ++i keeps the identifier first, i++ keeps it second.
+				if (exprs.size() == 2)
+				{
+					const bool pre = exprs[0] && std::holds_alternative<identifier>(exprs[0]->value());
+					os_ << (pre ? " pre" : " post");
+					inline_(pre ? exprs[0] : exprs[1]);
+					break;
+				}
+				[[fallthrough]];
+			default:
+				for (auto it = exprs.rbegin(); it != exprs.rend(); ++it)
+					inline_(*it);
+				break;
+			}
+			os_ << ")";
+		}
+
+		virtual void visit(new_blob_expression &ns)
+		{
+			os_ << "{";
+			bool first = true;
+			for (const auto &init : ns.initializers())
+			{
+				os_ << (first ? " " : ", ") << init.identifier << ":";
+				inline_(init.expr);
+				first = false;
+			}
+			os_ << " }";
+		}
+
+		virtual void visit(new_array_expression &nas)
+		{
+			os_ << "[";
+			bool first = true;
+			for (const auto &expr : nas.expressions())
+			{
+				if (!first)
+					os_ << ",";
+				inline_(expr);
+				first = false;
+			}
+			os_ << " ]";
+		}
+
+		virtual void visit(new_object_expression &nos)
+		{
+			os_ << "(new " << nos.type();
+			for (const auto &init : nos.initializers())
+			{
+				os_ << " " << init.identifier << ":";
+				inline_(init.expr);
+			}
+			os_ << ")";
+		}
+
+		virtual void visit(function_address_expression &fae)
+		{
+			os_ << "&" << fae.name();
+		}
+
+	private:
+		void open(const std::string &head)
+		{
+			if (!first_)
+				os_ << "\n";
+			first_ = false;
+			os_ << std::string(depth_ * 2, ' ') << "(" << head;
+		}
+
+		void close()
+		{
+			os_ << ")";
+		}
+
+		void child(const statement_ptr &stmt)
+		{
+			++depth_;
+			print(stmt);
+			--depth_;
+		}
+
+		void inline_(const expression_ptr &expr)
+		{
+			os_ << " ";
+			print(expr);
+		}
+
+		void literal(const value_t &v)
+		{
+			if (holds<std::string>(v))
+				os_ << "\"" << simpl::get<std::string>(v) << "\"";
+			else if (holds<empty_t>(v))
+				os_ << "empty";
+			else if (holds<bool>(v))
+				os_ << (simpl::get<bool>(v) ? "true" : "false");
+			else if (holds<double>(v))
+				os_ << cast<std::string>(v);
+			else
+				os_ << "<" << detail::get_type_string(v) << ">";
+		}
+
+		void name(const identifier &id)
+		{
+			os_ << id.name;
+			for (const auto &p : id.path)
+			{
+				if (std::holds_alternative<size_t>(p))
+					os_ << "[" << std::get<size_t>(p) << "]";
+				else
+					os_ << "." << std::get<std::string>(p);
+			}
+		}
+
+	private:
+		std::ostream &os_;
+		size_t depth_;
+		bool first_;
+	};
+
+	inline void dump(std::ostream &os, const syntax_tree &ast)
+	{
+		ast_printer p(os);
+		for (const auto &stmt : ast)
+			p.print(stmt);
+		os << "\n";
+	}
+
+	inline std::string dump(const statement_ptr &stmt)
+	{
+		std::stringstream ss;
+		ast_printer p(ss);
+		p.print(stmt);
+		return ss.str();
+	}
+}
+
+#endif // __simpl_dump_h__
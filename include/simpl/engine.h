@@ -9,6 +9,7 @@
 #include <simpl/libraries/array.h>
 #include <simpl/libraries/gui.h>
 #include <simpl/libraries/http.h>
+#include <simpl/libraries/stats.h>
 #include <simpl/libraries/string.h>
 
 namespace simpl
@@ -16,8 +17,8 @@ namespace simpl
     class engine
     {
     public:
-        engine()
-            :ctx_(vm_)
+        engine(const vm_limits &limits = vm_limits{})
+            :vm_(limits), ctx_(vm_)
         {
             vm_.register_library(std::make_unique<gui_lib>());
             vm_.register_library(std::make_unique<io_lib>());
@@ -25,8 +26,19 @@ namespace simpl
             vm_.register_library(std::make_unique<array_lib>());
             vm_.register_library(std::make_unique<string_lib>());
             vm_.register_library(std::make_unique<http_lib>());
+            vm_.register_library(std::make_unique<stats_lib>());
         }
 
+        // A copy of an idle engine, see vm(const vm &). Set up one engine
+        // with its imports and definitions and copy it for each use rather
+        // than building each from scratch.
+        engine(const engine &rhs)
+            :vm_(rhs.vm_), ctx_(vm_, rhs.ctx_)
+        {
+        }
+
+        engine &operator=(const engine &) = delete;
+
         vm_execution_context &context()
         {
             return ctx_;
@@ -8,17 +8,13 @@ namespace simpl
 	template <typename EngineT>
 	inline void evaluate(statement_ptr statement, EngineT &e)
 	{
-		if(statement)
-			statement->evaluate(e.context());
+		e.context().evaluate(std::move(statement));
 	}
 
 	template <typename EngineT>
 	inline void evaluate(syntax_tree &ast, EngineT &e)
 	{
-		for (auto &stmt : ast)
-		{
-			evaluate(std::move(stmt), e);
-		}
+		e.context().evaluate(ast);
 	}
 
 }
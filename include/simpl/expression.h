@@ -3,6 +3,9 @@
 
 #include <simpl/value.h>
 #include <simpl/op.h>
+#include <simpl/detail/arena.h>
+#include <simpl/detail/blob_map.h>
+#include <simpl/detail/type_ids.h>
 #include <simpl/detail/type_traits.h>
 
 #include <memory>
@@ -139,11 +142,36 @@ namespace simpl
 			return value_;
 		}
 
+		value_type& value()
+		{
+			return value_;
+		}
+
 		virtual ~expression() =default;
+
+		// nodes made while parsing come from the parse's arena.
+		static void *operator new(size_t size)
+		{
+			return detail::node_arena::allocate(size);
+		}
+
+		static void operator delete(void *p)
+		{
+			detail::node_arena::deallocate(p);
+		}
+
 	private:
 		value_type value_;
 	};
 
+	// the value of a literal expression, or nullptr.
+	inline const value_t *literal(const expression_ptr &expr)
+	{
+		if (!expr || !std::holds_alternative<value_t>(expr->value()))
+			return nullptr;
+		return &std::get<value_t>(expr->value());
+	}
+
 	class nary_expression : public expression
 	{
 		op_type op_;
@@ -179,6 +207,10 @@ namespace simpl
 		{
 			return expressions_;
 		}
+		std::vector<expression_ptr> &expressions()
+		{
+			return expressions_;
+		}
 
 		virtual void evaluate(expression_visitor &v) override
 		{
@@ -196,13 +228,22 @@ namespace simpl
 		new_blob_expression(initializer_list_t &&init)
 			:initializers_(std::move(init))
 		{
+			for (const auto &i : initializers_)
+				keys_.push_back(detail::atoms::intern(i.identifier));
 		}
 
-		const initializer_list_t& initializers()
+		initializer_list_t& initializers()
 		{
 			return initializers_;
 		}
 
+		// the initializers' keys, interned once here rather than each time
+		// a blob is made.
+		const std::vector<detail::atom> &keys() const
+		{
+			return keys_;
+		}
+
 		virtual void evaluate(expression_visitor &v) override
 		{
 			v.visit(*this);
@@ -210,13 +251,14 @@ namespace simpl
 
 	private:
 		initializer_list_t initializers_;
+		std::vector<detail::atom> keys_;
 	};
 
 	class new_object_expression : public expression
 	{
 	public:
 		new_object_expression(const std::string &type, initializer_list_t &&init)
-			:type_(type), initializers_(std::move(init))
+			:type_(type), type_id_(detail::type_ids::intern(type)), initializers_(std::move(init))
 		{
 		}
 
@@ -225,7 +267,14 @@ namespace simpl
 			return type_;
 		}
 
-		const initializer_list_t &initializers()
+		// the type's process wide id, so running the expression needn't look
+		// its name up.
+		size_t type_id() const
+		{
+			return type_id_;
+		}
+
+		initializer_list_t &initializers()
 		{
 			return initializers_;
 		}
@@ -237,6 +286,7 @@ namespace simpl
 
 	private:
 		std::string type_;
+		size_t type_id_;
 		initializer_list_t initializers_;
 
 	};
@@ -249,7 +299,7 @@ namespace simpl
 		{
 		}
 
-		const expression_list_t &expressions()
+		expression_list_t &expressions()
 		{
 			return expressions_;
 		}
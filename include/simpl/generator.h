@@ -0,0 +1,95 @@
+#ifndef __simpl_generator_h__
+#define __simpl_generator_h__
+
+#include <simpl/bytecode.h>
+#include <simpl/object.h>
+#include <simpl/value.h>
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace simpl
+{
+    namespace detail
+    {
+        // a scope of a suspended frame, its variables by their slot from the
+        // frame's base.
+        struct saved_scope
+        {
+            std::vector<std::pair<std::string, size_t>> variables;
+            size_t locals = 0;
+        };
+    }
+
+    /// <summary>
+    /// A call of a function that yields. Between resumes its frame lives
+    /// here instead of on the vm's stacks: where it's at, its values from
+    /// the frame's base up and its open scopes. vm::resume puts it back and
+    /// runs it to its next yield.
+    /// </summary>
+    class generator
+    {
+    public:
+        generator(std::shared_ptr<const chunk> body, const std::string &name, std::vector<value_t> &&arguments)
+            :body_(std::move(body)), name_(name), values_(std::move(arguments))
+        {
+        }
+
+        bool done() const
+        {
+            return done_;
+        }
+
+    private:
+        friend class vm;
+        std::shared_ptr<const chunk> body_;
+        std::string name_;
+        size_t pc_ = 0; // 0 until it's first resumed.
+        std::vector<value_t> values_;
+        std::vector<detail::saved_scope> scopes_;
+        bool running_ = false;
+        bool done_ = false;
+    };
+
+    // for in over an array, it sees what's pushed on while it goes.
+    struct array_iterator
+    {
+        arrayref_t array;
+        size_t next = 0;
+    };
+
+    template<>
+    struct detail::is_valid_arg_type<generator> : std::true_type {};
+
+    template<>
+    struct detail::simple_type_info<generator>
+    {
+        static const char *name() noexcept
+        {
+            return "generator";
+        }
+
+        static bool is_convertible(const std::string &)
+        {
+            return false;
+        }
+    };
+
+    template<>
+    struct detail::simple_type_info<array_iterator>
+    {
+        static const char *name() noexcept
+        {
+            return "array_iterator";
+        }
+
+        static bool is_convertible(const std::string &)
+        {
+            return false;
+        }
+    };
+}
+
+#endif // __simpl_generator_h__
@@ -2,9 +2,14 @@
 #define __simpl_array_h__
 
 #include <simpl/library.h>
+#include <simpl/vm.h>
 
 #include <algorithm>
+#include <exception>
+#include <map>
 #include <random>
+#include <thread>
+#include <utility>
 
 namespace simpl
 {
@@ -60,6 +65,179 @@ namespace simpl
 				return make_array(subset(arr.values.begin(), arr.values.begin() + static_cast<int>(cnt)));
 			});
 
+			// These take a function's address, map(a, &f). The function may
+			// change the array, each stops at its end as it was to begin with.
+			vm.reg_fn(detail::fn_def{ "map(array,string)", "map", { "array", "string" }, [](simpl::vm &self)
+			{
+				self.push_stack(make_array(map(self, simpl::get<arrayref_t>(self.stack_offset(1))->values, simpl::get<std::string>(std::as_const(self.stack_offset(0))))));
+				self.return_();
+			}, nullptr, {} });
+			vm.reg_fn(detail::fn_def{ "filter(array,string)", "filter", { "array", "string" }, [](simpl::vm &self)
+			{
+				const auto values = simpl::get<arrayref_t>(self.stack_offset(1))->values;
+				const auto fn = simpl::get<std::string>(std::as_const(self.stack_offset(0)));
+				std::vector<value_t> kept;
+				for (const auto &v : values)
+				{
+					if (cast<bool>(call(self, fn, { v })))
+						kept.push_back(v);
+				}
+				self.push_stack(make_array(std::move(kept)));
+				self.return_();
+			}, nullptr, {} });
+			vm.reg_fn(detail::fn_def{ "reduce(array,string,any)", "reduce", { "array", "string", "any" }, [](simpl::vm &self)
+			{
+				const auto values = simpl::get<arrayref_t>(self.stack_offset(2))->values;
+				self.push_stack(reduce(self, values.begin(), values.end(), simpl::get<std::string>(std::as_const(self.stack_offset(1))), self.stack_offset(0)));
+				self.return_();
+			}, nullptr, {} });
+			vm.reg_fn(detail::fn_def{ "for_each(array,string)", "for_each", { "array", "string" }, [](simpl::vm &self)
+			{
+				const auto values = simpl::get<arrayref_t>(self.stack_offset(1))->values;
+				const auto fn = simpl::get<std::string>(std::as_const(self.stack_offset(0)));
+				for (const auto &v : values)
+					call(self, fn, { v });
+				self.push_stack(value_t{});
+				self.return_();
+			}, nullptr, {} });
+
+			// map and reduce split across threads, each calling the function in
+			// a copy of the vm over copies of its share. The function sees the
+			// globals as they were, and what it changes stays in its copy.
+			// preduce's function has to be associative, init is only folded in
+			// once.
+			vm.reg_fn(detail::fn_def{ "pmap(array,string)", "pmap", { "array", "string" }, [](simpl::vm &self)
+			{
+				const auto fn = simpl::get<std::string>(std::as_const(self.stack_offset(0)));
+				auto parts = in_parallel(self, simpl::get<arrayref_t>(self.stack_offset(1))->values, [&](simpl::vm &vm, const std::vector<value_t> &share)
+				{
+					return map(vm, share, fn);
+				});
+				std::vector<value_t> mapped;
+				for (auto &part : parts)
+					std::move(part.begin(), part.end(), std::back_inserter(mapped));
+				self.push_stack(make_array(std::move(mapped)));
+				self.return_();
+			}, nullptr, {} });
+			vm.reg_fn(detail::fn_def{ "preduce(array,string,any)", "preduce", { "array", "string", "any" }, [](simpl::vm &self)
+			{
+				const auto fn = simpl::get<std::string>(std::as_const(self.stack_offset(1)));
+				auto parts = in_parallel(self, simpl::get<arrayref_t>(self.stack_offset(2))->values, [&](simpl::vm &vm, const std::vector<value_t> &share)
+				{
+					return std::vector<value_t>{ reduce(vm, share.begin() + 1, share.end(), fn, share.front()) };
+				});
+				value_t acc = self.stack_offset(0);
+				for (auto &part : parts)
+					acc = call(self, fn, { acc, part.front() });
+				self.push_stack(acc);
+				self.return_();
+			}, nullptr, {} });
+		}
+
+	private:
+		// a share of work for each thread is at least this many values.
+		static constexpr size_t Parallel_Grain = 1024;
+
+		// calls the function named fn, what it returns.
+		static value_t call(simpl::vm &vm, const std::string &fn, std::initializer_list<value_t> args)
+		{
+			vm.invoke_dynamic(fn, args);
+			return vm.pop_stack();
+		}
+
+		static std::vector<value_t> map(simpl::vm &vm, std::vector<value_t> values, const std::string &fn)
+		{
+			for (auto &v : values)
+				v = call(vm, fn, { v });
+			return values;
+		}
+
+		template <typename IteratorT>
+		static value_t reduce(simpl::vm &vm, IteratorT begin, IteratorT end, const std::string &fn, value_t acc)
+		{
+			for (; begin != end; ++begin)
+				acc = call(vm, fn, { acc, *begin });
+			return acc;
+		}
+
+		// part(vm, share) for each share of values, in order. With too few
+		// for two threads it's all one share in self.
+		template <typename PartT>
+		static std::vector<std::vector<value_t>> in_parallel(simpl::vm &self, const std::vector<value_t> &values, PartT &&part)
+		{
+			const size_t cores = std::max(1u, std::thread::hardware_concurrency());
+			const auto workers = std::min(cores, values.size() / Parallel_Grain);
+			if (workers <= 1)
+			{
+				if (values.empty())
+					return {};
+				return { part(self, std::vector<value_t>(values)) };
+			}
+
+			// self waits below, so the workers may all copy it at once. Each
+			// gets an even share of the operations self has left.
+			const auto &budget = self.budget();
+			const uint64_t remaining = budget.operations == 0 ? 0 : budget.operations - self.spent();
+			const uint64_t share_ops = budget.operations == 0 ? 0 : std::max<uint64_t>(1, remaining / workers);
+			std::vector<std::vector<value_t>> parts(workers);
+			std::vector<std::exception_ptr> errors(workers);
+			std::vector<uint64_t> spent(workers);
+			std::vector<std::thread> threads;
+			const auto per = (values.size() + workers - 1) / workers;
+			for (size_t w = 0; w < workers; ++w)
+			{
+				threads.emplace_back([&, w]()
+				{
+					try
+					{
+						simpl::vm vm(self);
+						auto evaluator = self.fallback() != nullptr ? self.fallback()->copy_for(vm) : nullptr;
+						vm.set_budget(work_budget{ share_ops, budget.deadline });
+
+						std::map<const void *, value_t> copies;
+						std::vector<value_t> share;
+						for (size_t i = w * per; i < std::min(values.size(), (w + 1) * per); ++i)
+							share.push_back(detail::deep_copy(values[i], copies));
+						try
+						{
+							parts[w] = part(vm, share);
+						}
+						catch (...)
+						{
+							errors[w] = std::current_exception();
+						}
+						spent[w] = vm.spent();
+					}
+					catch (...)
+					{
+						errors[w] = std::current_exception();
+					}
+				});
+			}
+			for (auto &t : threads)
+				t.join();
+
+			// what the workers did is self's work, a worker out of budget
+			// leaves self out of it too.
+			uint64_t total = 0;
+			for (const auto s : spent)
+				total += s;
+			self.charge(total);
+			for (const auto &e : errors)
+			{
+				if (!e)
+					continue;
+				try
+				{
+					std::rethrow_exception(e);
+				}
+				catch (const budget_exceeded &)
+				{
+					self.charge(remaining);
+					throw;
+				}
+			}
+			return parts;
 		}
 	};
 }
@@ -0,0 +1,49 @@
+#ifndef __simpl_stats_lib_h__
+#define __simpl_stats_lib_h__
+
+#include <simpl/library.h>
+#include <simpl/value.h>
+
+namespace simpl
+{
+	// stats() is a blob of the running vm's vm_stats, the import time in ms.
+	// enabled is 0 when the vm wasn't built with SIMPL_STATS.
+	class stats_lib final : public library
+	{
+	public:
+
+		const char *name() const override
+		{
+			return "stats";
+		}
+
+		void load(vm &vm) override
+		{
+			// takes the vm it's called in, copies of the vm have their own.
+			vm.reg_fn(detail::fn_def{ "stats()", "stats", {}, [](simpl::vm &self)
+			{
+				const auto s = self.stats();
+				auto blob = new_blob();
+				auto &values = blob->values;
+				values["enabled"] = vm_stats::enabled ? 1.0 : 0.0;
+				values["calls"] = static_cast<double>(s.calls);
+				values["exact_lookups"] = static_cast<double>(s.exact_lookups);
+				values["candidate_lookups"] = static_cast<double>(s.candidate_lookups);
+				values["is_a_checks"] = static_cast<double>(s.is_a_checks);
+				values["blobs"] = static_cast<double>(s.blobs);
+				values["arrays"] = static_cast<double>(s.arrays);
+				values["objects"] = static_cast<double>(s.objects);
+				values["pushes"] = static_cast<double>(s.pushes);
+				values["pops"] = static_cast<double>(s.pops);
+				values["imports"] = static_cast<double>(s.imports);
+				values["import_ms"] = s.import_time.count() / 1e6;
+				values["stack_high_water"] = static_cast<double>(s.stack_high_water);
+				values["scope_high_water"] = static_cast<double>(s.scope_high_water);
+				self.push_stack(blob);
+				self.return_();
+			}, nullptr, {} });
+		}
+	};
+}
+
+#endif //__simpl_stats_lib_h__
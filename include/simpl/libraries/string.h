@@ -35,7 +35,7 @@ namespace simpl
 						res.emplace_back(std::string{});
 						continue;
 					}
-					std::get<std::string>(res.back()).push_back(c);
+					simpl::get<std::string>(res.back()).push_back(c);
 				}
 				return make_array(std::move(res));
 			});
@@ -0,0 +1,804 @@
+#ifndef __simpl_module_cache_h__
+#define __simpl_module_cache_h__
+
+#include <simpl/detail/format.h>
+#include <simpl/expression.h>
+#include <simpl/parser.h>
+#include <simpl/source.h>
+#include <simpl/statement.h>
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <thread>
+
+// the interpreter version a cached module was made by; a build that
+// changes what the parser produces should change it.
+#ifndef SIMPL_VERSION
+#define SIMPL_VERSION "0.1.0"
+#endif
+
+namespace simpl
+{
+	namespace detail
+	{
+		// FNV-1a, stable across runs and platforms unlike std::hash.
+		inline uint64_t content_hash(std::string_view text, uint64_t h = 14695981039346656037ull)
+		{
+			for (auto c : text)
+			{
+				h ^= static_cast<unsigned char>(c);
+				h *= 1099511628211ull;
+			}
+			return h;
+		}
+	}
+
+	class cache_error : public std::runtime_error
+	{
+	public:
+		cache_error(const std::string &what)
+			:std::runtime_error(what)
+		{
+		}
+	};
+
+	/// <summary>
+	/// Writes a syntax tree as bytes, one tag per node followed by its
+	/// fields in order. Lengths and counts are varints and numbers their
+	/// eight bytes, little endian. Only the literals the parser makes
+	/// (empty, bool, number and string) can be written.
+	/// </summary>
+	class ast_writer : public statement_visitor, public expression_visitor
+	{
+	public:
+		static std::string write(const syntax_tree &ast)
+		{
+			ast_writer w;
+			w.u64(ast.size());
+			for (const auto &stmt : ast)
+				w.write(stmt);
+			return std::move(w.out_);
+		}
+
+	public:
+		virtual void visit(expr_statement &cs)
+		{
+			tag(statement_tag::expr);
+			write(cs.expr());
+		}
+
+		virtual void visit(let_statement &cs)
+		{
+			tag(statement_tag::let);
+			str(cs.name());
+			write(cs.expr());
+		}
+
+		virtual void visit(if_statement &is)
+		{
+			tag(statement_tag::if_);
+			for (auto if_stmt = &is; if_stmt != nullptr; if_stmt = if_stmt->next().get())
+			{
+				write(if_stmt->cond());
+				write(if_stmt->statement());
+				u8(if_stmt->next() ? 1 : 0);
+				if (!if_stmt->next())
+					write(if_stmt->else_statement());
+			}
+		}
+
+		virtual void visit(def_statement &ds)
+		{
+			tag(statement_tag::def);
+			str(ds.name());
+			u64(ds.arguments().size());
+			for (const auto &arg : ds.arguments())
+			{
+				str(arg.name);
+				opt(arg.type);
+			}
+			u8(ds.generator() ? 1 : 0);
+			write(ds.body());
+		}
+
+		virtual void visit(return_statement &rs)
+		{
+			tag(statement_tag::return_);
+			write(rs.expr());
+		}
+
+		virtual void visit(while_statement &ws)
+		{
+			tag(statement_tag::while_);
+			write(ws.cond());
+			write(ws.block());
+		}
+
+		virtual void visit(for_statement &fs)
+		{
+			tag(statement_tag::for_);
+			write(fs.init());
+			write(fs.cond());
+			write(fs.incr());
+			write(fs.block());
+		}
+
+		virtual void visit(for_in_statement &fs)
+		{
+			tag(statement_tag::for_in);
+			str(fs.name());
+			write(fs.source());
+			write(fs.block());
+		}
+
+		virtual void visit(yield_statement &ys)
+		{
+			tag(statement_tag::yield_);
+			write(ys.expr());
+		}
+
+		virtual void visit(block_statement &bs)
+		{
+			tag(statement_tag::block);
+			u64(bs.statements().size());
+			for (const auto &stmt : bs.statements())
+				write(stmt);
+		}
+
+		virtual void visit(object_definition_statement &os)
+		{
+			tag(statement_tag::object);
+			str(os.type_name());
+			opt(os.inherits());
+			u64(os.members().size());
+			for (const auto &m : os.members())
+			{
+				str(m.name);
+				write(m.initializer);
+			}
+		}
+
+		virtual void visit(import_statement &is)
+		{
+			tag(statement_tag::import);
+			str(is.libname());
+		}
+
+		virtual void visit(expression &ex)
+		{
+			tag(expression_tag::plain);
+			const auto &v = ex.value();
+			u8(static_cast<uint8_t>(v.index()));
+			if (std::holds_alternative<value_t>(v))
+				value(std::get<value_t>(v));
+			else if (std::holds_alternative<expression_ptr>(v))
+				write(std::get<expression_ptr>(v));
+			else if (std::holds_alternative<identifier>(v))
+				id(std::get<identifier>(v));
+		}
+
+		virtual void visit(nary_expression &ne)
+		{
+			tag(expression_tag::nary);
+			u8(static_cast<uint8_t>(ne.op()));
+			id(ne.identifier());
+			u64(ne.expressions().size());
+			for (const auto &expr : ne.expressions())
+				write(expr);
+		}
+
+		virtual void visit(new_blob_expression &ns)
+		{
+			tag(expression_tag::blob);
+			initializers(ns.initializers());
+		}
+
+		virtual void visit(new_array_expression &nas)
+		{
+			tag(expression_tag::array);
+			u64(nas.expressions().size());
+			for (const auto &expr : nas.expressions())
+				write(expr);
+		}
+
+		virtual void visit(new_object_expression &nos)
+		{
+			tag(expression_tag::object);
+			str(nos.type());
+			initializers(nos.initializers());
+		}
+
+		virtual void visit(function_address_expression &fae)
+		{
+			tag(expression_tag::address);
+			str(fae.name());
+		}
+
+	private:
+		friend class ast_reader;
+
+		enum class statement_tag : uint8_t { none, expr, let, if_, def, return_, while_, for_, block, object, import, for_in, yield_ };
+		enum class expression_tag : uint8_t { none, plain, nary, blob, array, object, address };
+
+		void write(const statement_ptr &stmt)
+		{
+			if (stmt)
+				stmt->evaluate(*this);
+			else
+				tag(statement_tag::none);
+		}
+
+		void write(const expression_ptr &expr)
+		{
+			if (expr)
+				expr->evaluate(*this);
+			else
+				tag(expression_tag::none);
+		}
+
+		void initializers(const initializer_list_t &init)
+		{
+			u64(init.size());
+			for (const auto &i : init)
+			{
+				str(i.identifier);
+				write(i.expr);
+			}
+		}
+
+		void id(const identifier &i)
+		{
+			str(i.name);
+			u64(i.path.size());
+			for (const auto &p : i.path)
+			{
+				u8(static_cast<uint8_t>(p.index()));
+				if (std::holds_alternative<std::string>(p))
+					str(std::get<std::string>(p));
+				else
+					u64(std::get<size_t>(p));
+			}
+		}
+
+		void value(const value_t &v)
+		{
+			if (holds<empty_t>(v))
+			{
+				u8(0);
+			}
+			else if (holds<bool>(v))
+			{
+				u8(1);
+				u8(cast<bool>(v) ? 1 : 0);
+			}
+			else if (holds<double>(v))
+			{
+				u8(2);
+				const double d = cast<double>(v);
+				uint64_t bits;
+				std::memcpy(&bits, &d, sizeof(bits));
+				fixed64(bits);
+			}
+			else if (holds<std::string>(v))
+			{
+				u8(3);
+				str(cast<std::string>(v));
+			}
+			else
+				throw cache_error("cannot cache a literal of this type");
+		}
+
+		void opt(const std::optional<std::string> &s)
+		{
+			u8(s.has_value() ? 1 : 0);
+			if (s.has_value())
+				str(s.value());
+		}
+
+		void str(const std::string &s)
+		{
+			u64(s.size());
+			out_.append(s);
+		}
+
+		template <typename TagT>
+		void tag(TagT t)
+		{
+			u8(static_cast<uint8_t>(t));
+		}
+
+		void u8(uint8_t v)
+		{
+			out_.push_back(static_cast<char>(v));
+		}
+
+		// lengths and counts, seven bits a byte.
+		void u64(uint64_t v)
+		{
+			while (v >= 0x80)
+			{
+				out_.push_back(static_cast<char>((v & 0x7F) | 0x80));
+				v >>= 7;
+			}
+			out_.push_back(static_cast<char>(v));
+		}
+
+		void fixed64(uint64_t v)
+		{
+			for (int i = 0; i < 8; ++i)
+				out_.push_back(static_cast<char>((v >> (i * 8)) & 0xFF));
+		}
+
+	private:
+		std::string out_;
+	};
+
+	/// <summary>
+	/// Reads back what ast_writer wrote. The nodes come from a new arena,
+	/// as they would from a parse. Anything out of place throws a
+	/// cache_error rather than making a tree that wasn't written.
+	/// </summary>
+	class ast_reader
+	{
+		using statement_tag = ast_writer::statement_tag;
+		using expression_tag = ast_writer::expression_tag;
+
+	public:
+		static syntax_tree read(std::string_view bytes)
+		{
+			detail::arena_ref arena(detail::node_arena::create());
+			detail::arena_scope scope(arena.get());
+			ast_reader r(bytes);
+			syntax_tree ast;
+			const auto count = r.count();
+			for (uint64_t i = 0; i < count; ++i)
+				ast.emplace_back(r.stmt());
+			if (r.p_ != r.end_)
+				throw cache_error("trailing bytes");
+			return ast;
+		}
+
+	private:
+		ast_reader(std::string_view bytes)
+			:p_(bytes.data()), end_(bytes.data() + bytes.size())
+		{
+		}
+
+		statement_ptr stmt()
+		{
+			switch (static_cast<statement_tag>(u8()))
+			{
+			case statement_tag::none:
+				return nullptr;
+			case statement_tag::expr:
+				return std::make_unique<expr_statement>(expr());
+			case statement_tag::let:
+			{
+				auto name = str();
+				return std::make_unique<let_statement>(name, expr());
+			}
+			case statement_tag::if_:
+				return if_stmt();
+			case statement_tag::def:
+			{
+				auto name = str();
+				std::vector<argument> args;
+				const auto n = count();
+				for (uint64_t i = 0; i < n; ++i)
+				{
+					auto arg = argument(str());
+					arg.type = opt();
+					args.emplace_back(std::move(arg));
+				}
+				const bool generator = u8() != 0;
+				auto body = stmt();
+				return std::make_unique<def_statement>(name, std::move(args), std::move(body), generator);
+			}
+			case statement_tag::return_:
+				return std::make_unique<return_statement>(expr());
+			case statement_tag::while_:
+			{
+				auto cond = expr();
+				return std::make_unique<while_statement>(std::move(cond), stmt());
+			}
+			case statement_tag::for_:
+			{
+				auto init = stmt();
+				auto cond = expr();
+				auto incr = expr();
+				return std::make_unique<for_statement>(std::move(init), std::move(cond), std::move(incr), stmt());
+			}
+			case statement_tag::block:
+			{
+				auto blk = std::make_unique<block_statement>();
+				const auto n = count();
+				for (uint64_t i = 0; i < n; ++i)
+					blk->add(stmt());
+				return blk;
+			}
+			case statement_tag::object:
+			{
+				auto name = str();
+				auto inherits = opt();
+				std::vector<object_definition::member> members;
+				const auto n = count();
+				for (uint64_t i = 0; i < n; ++i)
+				{
+					auto member = str();
+					members.emplace_back(member, expr());
+				}
+				return std::make_unique<object_definition_statement>(name, inherits, std::move(members));
+			}
+			case statement_tag::import:
+				return std::make_unique<import_statement>(str());
+			case statement_tag::for_in:
+			{
+				auto name = str();
+				auto source = expr();
+				return std::make_unique<for_in_statement>(name, std::move(source), stmt());
+			}
+			case statement_tag::yield_:
+				return std::make_unique<yield_statement>(expr());
+			default:
+				throw cache_error("bad statement tag");
+			}
+		}
+
+		std::unique_ptr<if_statement> if_stmt()
+		{
+			auto cond = expr();
+			auto result = std::make_unique<if_statement>(std::move(cond), stmt());
+			if (u8() != 0)
+				result->next(if_stmt());
+			else
+				result->else_statement(stmt());
+			return result;
+		}
+
+		expression_ptr expr()
+		{
+			switch (static_cast<expression_tag>(u8()))
+			{
+			case expression_tag::none:
+				return nullptr;
+			case expression_tag::plain:
+				switch (u8())
+				{
+				case 0:
+					return std::make_unique<expression>();
+				case 1:
+					return std::make_unique<expression>(value());
+				case 2:
+					return std::make_unique<expression>(expr());
+				case 3:
+					return std::make_unique<expression>(id());
+				default:
+					throw cache_error("bad expression value");
+				}
+			case expression_tag::nary:
+			{
+				const auto op = u8();
+				if (op > static_cast<uint8_t>(op_type::none))
+					throw cache_error("bad operator");
+				auto i = id();
+				std::vector<expression_ptr> exprs;
+				const auto n = count();
+				for (uint64_t k = 0; k < n; ++k)
+					exprs.emplace_back(expr());
+				if (static_cast<op_type>(op) == op_type::func)
+					return std::make_unique<nary_expression>(i, std::move(exprs));
+				auto ne = std::make_unique<nary_expression>(static_cast<op_type>(op));
+				ne->add(std::move(exprs));
+				return ne;
+			}
+			case expression_tag::blob:
+				return std::make_unique<new_blob_expression>(initializers());
+			case expression_tag::array:
+			{
+				expression_list_t exprs;
+				const auto n = count();
+				for (uint64_t i = 0; i < n; ++i)
+					exprs.emplace_back(expr());
+				return std::make_unique<new_array_expression>(std::move(exprs));
+			}
+			case expression_tag::object:
+			{
+				auto type = str();
+				return std::make_unique<new_object_expression>(type, initializers());
+			}
+			case expression_tag::address:
+				return std::make_unique<function_address_expression>(str());
+			default:
+				throw cache_error("bad expression tag");
+			}
+		}
+
+		initializer_list_t initializers()
+		{
+			initializer_list_t init;
+			const auto n = count();
+			for (uint64_t i = 0; i < n; ++i)
+			{
+				auto name = str();
+				init.emplace_back(std::move(name), expr());
+			}
+			return init;
+		}
+
+		identifier id()
+		{
+			identifier i(str());
+			const auto n = count();
+			for (uint64_t k = 0; k < n; ++k)
+			{
+				if (u8() == 0)
+					i.push_path(str());
+				else
+					i.push_path(static_cast<size_t>(u64()));
+			}
+			return i;
+		}
+
+		value_t value()
+		{
+			switch (u8())
+			{
+			case 0:
+				return value_t{};
+			case 1:
+				return value_t{ u8() != 0 };
+			case 2:
+			{
+				const auto bits = fixed64();
+				double d;
+				std::memcpy(&d, &bits, sizeof(d));
+				return value_t{ d };
+			}
+			case 3:
+				return value_t{ str() };
+			default:
+				throw cache_error("bad literal");
+			}
+		}
+
+		std::optional<std::string> opt()
+		{
+			if (u8() == 0)
+				return std::nullopt;
+			return str();
+		}
+
+		std::string str()
+		{
+			const auto n = count();
+			std::string s(p_, static_cast<size_t>(n));
+			p_ += n;
+			return s;
+		}
+
+		// a length or count, which can't be more than the bytes left.
+		uint64_t count()
+		{
+			const auto n = u64();
+			if (n > static_cast<uint64_t>(end_ - p_))
+				throw cache_error("bad length");
+			return n;
+		}
+
+		uint8_t u8()
+		{
+			need(1);
+			return static_cast<uint8_t>(*p_++);
+		}
+
+		uint64_t u64()
+		{
+			uint64_t v = 0;
+			for (int shift = 0; shift < 64; shift += 7)
+			{
+				const auto b = u8();
+				v |= static_cast<uint64_t>(b & 0x7F) << shift;
+				if ((b & 0x80) == 0)
+					return v;
+			}
+			throw cache_error("bad length");
+		}
+
+		uint64_t fixed64()
+		{
+			need(8);
+			uint64_t v = 0;
+			for (int i = 0; i < 8; ++i)
+				v |= static_cast<uint64_t>(static_cast<unsigned char>(*p_++)) << (i * 8);
+			return v;
+		}
+
+		void need(size_t n)
+		{
+			if (static_cast<size_t>(end_ - p_) < n)
+				throw cache_error("truncated");
+		}
+
+	private:
+		const char *p_;
+		const char *end_;
+	};
+
+	/// <summary>
+	/// A directory of parsed modules. Each file is named for the hash of
+	/// the interpreter version and the module's text, and starts with a
+	/// header naming both along with the length and hash of the tree that
+	/// follows. A file that doesn't match on all of them is parsed again
+	/// and replaced, so a stale or torn file costs a parse, never a wrong
+	/// tree.
+	/// </summary>
+	class module_cache
+	{
+		static constexpr char Magic[8] = { 's', 'i', 'm', 'p', 'l', 'a', 's', 't' };
+		static constexpr uint32_t Format = 2; // 2: def has a generator flag, for-in and yield.
+
+	public:
+		explicit module_cache(const std::filesystem::path &dir)
+			:dir_(dir)
+		{
+		}
+
+		// the directory in SIMPL_CACHE, if it's set.
+		static std::optional<module_cache> from_environment()
+		{
+#ifdef _WIN32
+			char *env = nullptr;
+			size_t len = 0;
+			if (_dupenv_s(&env, &len, "SIMPL_CACHE") != 0 || env == nullptr)
+				return std::nullopt;
+			std::string dir(env);
+			free(env);
+#else
+			const char *env = std::getenv("SIMPL_CACHE");
+			if (env == nullptr)
+				return std::nullopt;
+			std::string dir(env);
+#endif
+			if (dir.empty())
+				return std::nullopt;
+			return module_cache(dir);
+		}
+
+		const std::filesystem::path &directory() const
+		{
+			return dir_;
+		}
+
+		std::filesystem::path path_for(const source_buffer &source) const
+		{
+			const auto key = detail::content_hash(source.view(), detail::content_hash(SIMPL_VERSION));
+			char name[32];
+			std::snprintf(name, sizeof(name), "%016llx.slc", static_cast<unsigned long long>(key));
+			return dir_ / name;
+		}
+
+		// the cached tree for source, or a parse of it which is then cached.
+		syntax_tree load(const source_buffer &source)
+		{
+			if (auto ast = find(source))
+				return std::move(ast.value());
+			auto ast = simpl::parse(source);
+			store(source, ast);
+			return ast;
+		}
+
+		std::optional<syntax_tree> find(const source_buffer &source) const
+		{
+			const auto path = path_for(source);
+			std::error_code ec;
+			if (!std::filesystem::exists(path, ec))
+				return std::nullopt;
+			try
+			{
+				auto file = source_buffer::map(path);
+				auto bytes = file.view();
+				if (bytes.size() < Header_Size || bytes.substr(0, Header_Size) != header(source, {}))
+					return std::nullopt;
+				auto payload = bytes.substr(Header_Size);
+				if (payload.size() < 16)
+					return std::nullopt;
+				const auto size = read_u64(payload.data());
+				const auto hash = read_u64(payload.data() + 8);
+				payload.remove_prefix(16);
+				if (size != payload.size() || hash != detail::content_hash(payload))
+					return std::nullopt;
+				return ast_reader::read(payload);
+			}
+			catch (const std::runtime_error &)
+			{
+				return std::nullopt;
+			}
+		}
+
+		// best effort; a tree that can't be written or a directory that
+		// can't be is left uncached.
+		void store(const source_buffer &source, const syntax_tree &ast) const
+		{
+			try
+			{
+				const auto payload = ast_writer::write(ast);
+				auto bytes = header(source, payload);
+
+				std::error_code ec;
+				std::filesystem::create_directories(dir_, ec);
+				const auto path = path_for(source);
+				// written aside and renamed into place, so a reader in
+				// another process never sees half a file.
+				auto tmp = path;
+				tmp += detail::format(".{0}.{1}.tmp",
+					std::hash<std::thread::id>{}(std::this_thread::get_id()),
+					std::chrono::steady_clock::now().time_since_epoch().count());
+				{
+					std::ofstream os(tmp, std::ios::binary | std::ios::trunc);
+					os.write(bytes.data(), static_cast<std::streamsize>(bytes.size()));
+					os.write(payload.data(), static_cast<std::streamsize>(payload.size()));
+					if (!os)
+					{
+						os.close();
+						std::filesystem::remove(tmp, ec);
+						return;
+					}
+				}
+				std::filesystem::rename(tmp, path, ec);
+				if (ec)
+					std::filesystem::remove(tmp, ec);
+			}
+			catch (const std::runtime_error &)
+			{
+			}
+		}
+
+	private:
+		static constexpr size_t Header_Size = sizeof(Magic) + 4 + 8 + 8 + 8;
+
+		// magic, format, interpreter version hash, source length and hash;
+		// then, when writing, the payload length and hash.
+		static std::string header(const source_buffer &source, std::string_view payload)
+		{
+			std::string h(Magic, sizeof(Magic));
+			put(h, Format, 4);
+			put(h, detail::content_hash(SIMPL_VERSION), 8);
+			put(h, source.size(), 8);
+			put(h, detail::content_hash(source.view()), 8);
+			if (payload.data() != nullptr)
+			{
+				put(h, payload.size(), 8);
+				put(h, detail::content_hash(payload), 8);
+			}
+			return h;
+		}
+
+		static void put(std::string &out, uint64_t v, int bytes)
+		{
+			for (int i = 0; i < bytes; ++i)
+				out.push_back(static_cast<char>((v >> (i * 8)) & 0xFF));
+		}
+
+		static uint64_t read_u64(const char *p)
+		{
+			uint64_t v = 0;
+			for (int i = 0; i < 8; ++i)
+				v |= static_cast<uint64_t>(static_cast<unsigned char>(p[i])) << (i * 8);
+			return v;
+		}
+
+	private:
+		std::filesystem::path dir_;
+	};
+}
+
+#endif // __simpl_module_cache_h__
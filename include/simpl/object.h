@@ -1,20 +1,38 @@
 #ifndef __simpl_object_h__
 #define __simpl_object_h__
 
+#include <simpl/detail/type_ids.h>
 #include <simpl/detail/type_traits.h>
 
 #include <memory>
 
 namespace simpl
 {
+    namespace detail
+    {
+        class shape;
+    }
+
     class object
     {
     public:
         virtual ~object() = default;
         virtual std::string type() const = 0;
 
+        // the interned id of type(), override to avoid the lookup.
+        virtual size_t type_id() const
+        {
+            return detail::type_ids::intern(type());
+        }
+
         virtual bool is_convertible(const std::string &t) = 0;
         virtual void *value() = 0;
+
+        // the member layout of a script object, native objects have none.
+        virtual const detail::shape *layout() const
+        {
+            return nullptr;
+        }
     };
 
     template <typename T>
@@ -32,6 +50,12 @@ namespace simpl
             return detail::simple_type_info<T>::name();
         }
 
+        size_t type_id() const
+        {
+            static const size_t id = detail::type_ids::intern(detail::simple_type_info<T>::name());
+            return id;
+        }
+
         bool is_convertible(const std::string &t)
         {
             return detail::simple_type_info<T>::is_convertible(t);
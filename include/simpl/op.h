@@ -94,68 +94,81 @@ namespace simpl
 						|| c == '|' || c == '.';
 	}
 
+	// switches on the length then the characters, ops are at most three long.
 	template <typename IteratorT>
 	op_type to_op_type(IteratorT begin, IteratorT end)
 	{
-		if (builtins::compare(begin, end, "+"))
-			return op_type::add;
-		else if (builtins::compare(begin, end, "++"))
-			return op_type::increment;
-		else if (builtins::compare(begin, end, "--"))
-			return op_type::decrement;
-		else if (builtins::compare(begin, end, "="))
-			return op_type::eq;
-		else if (builtins::compare(begin, end, "-"))
-			return op_type::sub;
-		else if (builtins::compare(begin, end, "/"))
-			return op_type::div;
-		else if (builtins::compare(begin, end, "*"))
-			return op_type::mult;
-		else if (builtins::compare(begin, end, "=="))
-			return op_type::eqeq;
-		else if (builtins::compare(begin, end, "!="))
-			return op_type::neq;
-		else if (builtins::compare(begin, end, "<"))
-			return op_type::lt;
-		else if (builtins::compare(begin, end, "<="))
-			return op_type::lteq;
-		else if (builtins::compare(begin, end, ">"))
-			return op_type::gt;
-		else if (builtins::compare(begin, end, ">="))
-			return op_type::gteq;
-		else if (builtins::compare(begin, end, "&"))
-			return op_type::bin_and;
-		else if (builtins::compare(begin, end, "&&"))
-			return op_type::log_and;
-		else if (builtins::compare(begin, end, "||"))
-			return op_type::log_or;
-		else if (builtins::compare(begin, end, "..."))
-			return op_type::expand;
+		switch (end - begin)
+		{
+		case 1:
+			switch (begin[0])
+			{
+			case '+': return op_type::add;
+			case '-': return op_type::sub;
+			case '=': return op_type::eq;
+			case '/': return op_type::div;
+			case '*': return op_type::mult;
+			case '<': return op_type::lt;
+			case '>': return op_type::gt;
+			case '&': return op_type::bin_and;
+			}
+			break;
+		case 2:
+			switch (begin[0])
+			{
+			case '+': return begin[1] == '+' ? op_type::increment : op_type::none;
+			case '-': return begin[1] == '-' ? op_type::decrement : op_type::none;
+			case '=': return begin[1] == '=' ? op_type::eqeq : op_type::none;
+			case '!': return begin[1] == '=' ? op_type::neq : op_type::none;
+			case '<': return begin[1] == '=' ? op_type::lteq : op_type::none;
+			case '>': return begin[1] == '=' ? op_type::gteq : op_type::none;
+			case '&': return begin[1] == '&' ? op_type::log_and : op_type::none;
+			case '|': return begin[1] == '|' ? op_type::log_or : op_type::none;
+			}
+			break;
+		case 3:
+			if (begin[0] == '.' && begin[1] == '.' && begin[2] == '.')
+				return op_type::expand;
+			break;
+		}
 		return op_type::none;
 	}
 
 	template <typename IteratorT>
-	inline bool is_op_maybe(IteratorT begin, IteratorT end)
+	inline bool is_op(IteratorT begin, IteratorT end)
 	{
-		return 
-			builtins::compare(begin, end, "+") ||
-			builtins::compare(begin, end, "-") ||
-			builtins::compare(begin, end, "|") ||
-			builtins::compare(begin, end, "&") ||
-			builtins::compare(begin, end, "<") ||
-			builtins::compare(begin, end, ">") ||
-			builtins::compare(begin, end, "!") ||
-			builtins::compare(begin, end, "=") ||
-			builtins::compare(begin, end, ".") ||
-			builtins::compare(begin, end, "..");
+		return to_op_type(begin, end) != op_type::none;
 	}
 
+	// the length of the longest op starting at begin, which is an op char.
+	// A pair that isn't an op splits, so '|' and '..' can still come back.
 	template <typename IteratorT>
-	inline bool is_op(IteratorT begin, IteratorT end)
+	inline size_t op_length(IteratorT begin, IteratorT end)
 	{
-		return to_op_type(begin, end) != op_type::none;
-	}
+		if (end - begin < 2)
+			return 1;
 
+		const auto next = begin[1];
+		switch (begin[0])
+		{
+		case '+':
+		case '-':
+		case '&':
+		case '|':
+			return next == begin[0] ? 2 : 1;
+		case '=':
+		case '!':
+		case '<':
+		case '>':
+			return next == '=' ? 2 : 1;
+		case '.':
+			if (next != '.')
+				return 1;
+			return end - begin > 2 && begin[2] == '.' ? 3 : 2;
+		default:
+			return 1;
+		}
+	}
 
 }
 
@@ -1,9 +1,11 @@
 #ifndef __simpl_operations_h__
 #define __simpl_operations_h__
 
+#include <array>
 #include <stdexcept>
 
 #include <simpl/cast.h>
+#include <simpl/detail/type_ids.h>
 #include <simpl/value.h>
 
 namespace simpl
@@ -17,33 +19,35 @@ namespace simpl
         }
     };
 
-    template <typename OpT>
-    value_t apply(value_t lvalue, value_t rvalue)
-    {
-        OpT op(rvalue);
-        std::visit(op, lvalue);
-        return op.result;
-    }
-
     template <typename ResultT>
     struct op_base
     {
-        op_base(value_t &rvalue)
+        explicit op_base(const value_t &rvalue)
             :rvalue(rvalue)
         {
         }
 
-        value_t &rvalue;
+        const value_t &rvalue;
         ResultT result = ResultT{};
     };
 
     struct add_op : op_base<value_t>
     {
-        add_op(value_t &rvalue)
+        explicit add_op(const value_t &rvalue)
             :op_base(rvalue)
         {
         }
 
+        static value_t compute(double lv, double rv)
+        {
+            return lv + rv;
+        }
+
+        static value_t compute(const std::string &lv, const std::string &rv)
+        {
+            return lv + rv;
+        }
+
         void operator()(const empty_t &lv)
         {
             result = lv;
@@ -51,14 +55,12 @@ namespace simpl
 
         void operator()(double lv)
         {
-            double rv = cast<double>(rvalue);
-            result = lv + rv;
+            result = compute(lv, cast<double>(rvalue));
         }
 
         void operator()(const std::string &lv)
         {
-            std::string rv = cast<std::string>(rvalue);
-            result = lv + rv;
+            result = compute(lv, cast<std::string>(rvalue));
         }
 
         void operator()(const blobref_t &v)
@@ -80,11 +82,21 @@ namespace simpl
 
     struct sub_op : op_base<value_t>
     {
-        sub_op(value_t &rvalue)
+        explicit sub_op(const value_t &rvalue)
             :op_base(rvalue)
         {
         }
 
+        static value_t compute(double lv, double rv)
+        {
+            return lv - rv;
+        }
+
+        static value_t compute(const std::string &lv, const std::string &rv)
+        {
+            throw invalid_operation();
+        }
+
         void operator()(const empty_t &lv)
         {
             result = lv;
@@ -92,8 +104,7 @@ namespace simpl
 
         void operator()(double lv)
         {
-            double rv = cast<double>(rvalue);
-            result = lv - rv;
+            result = compute(lv, cast<double>(rvalue));
         }
 
         void operator()(const std::string &lv)
@@ -119,11 +130,21 @@ namespace simpl
 
     struct mult_op : op_base<value_t>
     {
-        mult_op(value_t &rvalue)
+        explicit mult_op(const value_t &rvalue)
             :op_base(rvalue)
         {
         }
 
+        static value_t compute(double lv, double rv)
+        {
+            return lv * rv;
+        }
+
+        static value_t compute(const std::string &lv, const std::string &rv)
+        {
+            throw invalid_operation();
+        }
+
         void operator()(const empty_t &lv)
         {
             result = lv;
@@ -131,8 +152,7 @@ namespace simpl
 
         void operator()(double lv)
         {
-            double rv = cast<double>(rvalue);
-            result = lv * rv;
+            result = compute(lv, cast<double>(rvalue));
         }
 
         void operator()(const std::string &lv)
@@ -158,11 +178,21 @@ namespace simpl
 
     struct div_op : op_base<value_t>
     {
-        div_op(value_t &rvalue)
+        explicit div_op(const value_t &rvalue)
             :op_base(rvalue)
         {
         }
 
+        static value_t compute(double lv, double rv)
+        {
+            return lv / rv;
+        }
+
+        static value_t compute(const std::string &lv, const std::string &rv)
+        {
+            throw invalid_operation();
+        }
+
         void operator()(const empty_t &lv)
         {
             result = lv;
@@ -170,8 +200,7 @@ namespace simpl
 
         void operator()(double lv)
         {
-            double rv = cast<double>(rvalue);
-            result = lv / rv;
+            result = compute(lv, cast<double>(rvalue));
         }
 
         void operator()(const std::string &lv)
@@ -197,24 +226,34 @@ namespace simpl
 
     struct eqeq_op : op_base<bool>
     {
-        eqeq_op(value_t &rvalue)
+        explicit eqeq_op(const value_t &rvalue)
             :op_base(rvalue)
         {
         }
 
+        static bool compute(double lv, double rv)
+        {
+            return lv == rv;
+        }
+
+        static bool compute(const std::string &lv, const std::string &rv)
+        {
+            return lv == rv;
+        }
+
         void operator()(const empty_t &lv)
         {
-            result = std::holds_alternative<empty_t>(rvalue);
+            result = holds<empty_t>(rvalue);
         }
 
         void operator()(double lv)
         {
-            result = lv == cast<double>(rvalue);
+            result = compute(lv, cast<double>(rvalue));
         }
 
         void operator()(const std::string &lv)
         {
-            result = lv == cast<std::string>(rvalue);
+            result = compute(lv, cast<std::string>(rvalue));
         }
 
         void operator()(const blobref_t &v)
@@ -235,24 +274,34 @@ namespace simpl
 
     struct neq_op : op_base<bool>
     {
-        neq_op(value_t &rvalue)
+        explicit neq_op(const value_t &rvalue)
             :op_base(rvalue)
         {
         }
 
+        static bool compute(double lv, double rv)
+        {
+            return lv != rv;
+        }
+
+        static bool compute(const std::string &lv, const std::string &rv)
+        {
+            return lv != rv;
+        }
+
         void operator()(const empty_t &lv)
         {
-            result = !std::holds_alternative<empty_t>(rvalue);
+            result = !holds<empty_t>(rvalue);
         }
 
         void operator()(double lv)
         {
-            result = lv != cast<double>(rvalue);
+            result = compute(lv, cast<double>(rvalue));
         }
 
         void operator()(const std::string &lv)
         {
-            result = lv != cast<std::string>(rvalue);
+            result = compute(lv, cast<std::string>(rvalue));
         }
         
         void operator()(const blobref_t &v)
@@ -273,11 +322,21 @@ namespace simpl
 
     struct lt_op : op_base<bool>
     {
-        lt_op(value_t &rvalue)
+        explicit lt_op(const value_t &rvalue)
             :op_base(rvalue)
         {
         }
 
+        static bool compute(double lv, double rv)
+        {
+            return lv < rv;
+        }
+
+        static bool compute(const std::string &lv, const std::string &rv)
+        {
+            return lv < rv;
+        }
+
         void operator()(const empty_t &lv)
         {
             result = false;
@@ -285,12 +344,12 @@ namespace simpl
 
         void operator()(double lv)
         {
-            result = lv < cast<double>(rvalue);
+            result = compute(lv, cast<double>(rvalue));
         }
 
         void operator()(const std::string &lv)
         {
-            result = lv < cast<std::string>(rvalue);
+            result = compute(lv, cast<std::string>(rvalue));
         }
 
         void operator()(const blobref_t &v)
@@ -311,11 +370,21 @@ namespace simpl
 
     struct lte_op : op_base<bool>
     {
-        lte_op(value_t &rvalue)
+        explicit lte_op(const value_t &rvalue)
             :op_base(rvalue)
         {
         }
 
+        static bool compute(double lv, double rv)
+        {
+            return lv <= rv;
+        }
+
+        static bool compute(const std::string &lv, const std::string &rv)
+        {
+            return lv <= rv;
+        }
+
         void operator()(const empty_t &lv)
         {
             result = false;
@@ -323,12 +392,12 @@ namespace simpl
 
         void operator()(double lv)
         {
-            result = lv <= cast<double>(rvalue);
+            result = compute(lv, cast<double>(rvalue));
         }
 
         void operator()(const std::string &lv)
         {
-            result = lv <= cast<std::string>(rvalue);
+            result = compute(lv, cast<std::string>(rvalue));
         }
 
         void operator()(const blobref_t &v)
@@ -349,11 +418,21 @@ namespace simpl
 
     struct gt_op : op_base<bool>
     {
-        gt_op(value_t &rvalue)
+        explicit gt_op(const value_t &rvalue)
             :op_base(rvalue)
         {
         }
 
+        static bool compute(double lv, double rv)
+        {
+            return lv > rv;
+        }
+
+        static bool compute(const std::string &lv, const std::string &rv)
+        {
+            return lv > rv;
+        }
+
         void operator()(const empty_t &lv)
         {
             result = false;
@@ -361,12 +440,12 @@ namespace simpl
 
         void operator()(double lv)
         {
-            result = lv > cast<double>(rvalue);
+            result = compute(lv, cast<double>(rvalue));
         }
 
         void operator()(const std::string &lv)
         {
-            result = lv > cast<std::string>(rvalue);
+            result = compute(lv, cast<std::string>(rvalue));
         }
 
         void operator()(const blobref_t &v)
@@ -387,11 +466,21 @@ namespace simpl
 
     struct gte_op : op_base<bool>
     {
-        gte_op(value_t &rvalue)
+        explicit gte_op(const value_t &rvalue)
             :op_base(rvalue)
         {
         }
 
+        static bool compute(double lv, double rv)
+        {
+            return lv >= rv;
+        }
+
+        static bool compute(const std::string &lv, const std::string &rv)
+        {
+            return lv >= rv;
+        }
+
         void operator()(const empty_t &lv)
         {
             result = false;
@@ -399,12 +488,12 @@ namespace simpl
 
         void operator()(double lv)
         {
-            result = lv >= cast<double>(rvalue);
+            result = compute(lv, cast<double>(rvalue));
         }
 
         void operator()(const std::string &lv)
         {
-            result = lv >= cast<std::string>(rvalue);
+            result = compute(lv, cast<std::string>(rvalue));
         }
 
         void operator()(const blobref_t &v)
@@ -424,7 +513,73 @@ namespace simpl
 
     };
 
+    namespace detail
+    {
+        using kernel_t = value_t(*)(const value_t &, const value_t &);
+
+        constexpr size_t value_kinds = 7;
+#ifndef SIMPL_NAN_BOXING
+        static_assert(std::variant_size_v<value_t> == value_kinds, "a value kind is missing a row in the kernel table");
+#endif
+        using kernel_table_t = std::array<std::array<kernel_t, value_kinds>, value_kinds>;
+
+        // the general case, visits the left and casts the right to match.
+        template <typename OpT>
+        value_t any_kernel(const value_t &lvalue, const value_t &rvalue)
+        {
+            OpT op(rvalue);
+            simpl::visit(op, lvalue);
+            return op.result;
+        }
+
+        template <typename OpT>
+        value_t number_kernel(const value_t &lvalue, const value_t &rvalue)
+        {
+            return OpT::compute(simpl::get<double>(lvalue), simpl::get<double>(rvalue));
+        }
+
+        template <typename OpT>
+        value_t string_kernel(const value_t &lvalue, const value_t &rvalue)
+        {
+            if constexpr (std::is_same_v<OpT, eqeq_op>)
+                return same_text(lvalue, rvalue);
+            else if constexpr (std::is_same_v<OpT, neq_op>)
+                return !same_text(lvalue, rvalue);
+            else
+                return OpT::compute(simpl::get<std::string>(lvalue), simpl::get<std::string>(rvalue));
+        }
 
+        template <typename OpT>
+        value_t string_number_kernel(const value_t &lvalue, const value_t &rvalue)
+        {
+            return OpT::compute(simpl::get<std::string>(lvalue), to<std::string>(simpl::get<double>(rvalue)));
+        }
+
+        template <typename OpT>
+        constexpr kernel_table_t make_kernels()
+        {
+            kernel_table_t table{};
+            for (auto &row : table)
+            {
+                for (auto &k : row)
+                    k = &any_kernel<OpT>;
+            }
+            table[type_ids::number][type_ids::number] = &number_kernel<OpT>;
+            table[type_ids::string][type_ids::string] = &string_kernel<OpT>;
+            table[type_ids::string][type_ids::number] = &string_number_kernel<OpT>;
+            return table;
+        }
+
+        // indexed by the alternatives of the left and right operands.
+        template <typename OpT>
+        inline constexpr kernel_table_t kernels = make_kernels<OpT>();
+    }
+
+    template <typename OpT>
+    value_t apply(const value_t &lvalue, const value_t &rvalue)
+    {
+        return detail::kernels<OpT>[lvalue.index()][rvalue.index()](lvalue, rvalue);
+    }
 }
 
 
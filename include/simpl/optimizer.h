@@ -0,0 +1,591 @@
+#ifndef __simpl_optimizer_h__
+#define __simpl_optimizer_h__
+
+#include <simpl/cast.h>
+#include <simpl/expression.h>
+#include <simpl/operations.h>
+#include <simpl/statement.h>
+#include <simpl/value.h>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <optional>
+#include <set>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace simpl
+{
+	namespace detail
+	{
+		// true or false for a literal that can be tested, nullopt otherwise.
+		inline std::optional<bool> truth(const expression_ptr &expr)
+		{
+			auto v = literal(expr);
+			if (!v)
+				return std::nullopt;
+			try
+			{
+				return cast<bool>(*v);
+			}
+			catch (const std::exception &)
+			{
+				return std::nullopt;
+			}
+		}
+
+		/// <summary>
+		/// What running a piece of code can do to the variables around it:
+		/// the names it assigns, and whether it calls out to code that could
+		/// assign anything (a function, a constructor or an import).
+		/// </summary>
+		class effects : public statement_visitor, public expression_visitor
+		{
+		public:
+			bool opaque = false;
+			std::set<std::string> writes;
+
+			void scan(const statement_ptr &stmt)
+			{
+				if (stmt)
+					stmt->evaluate(*this);
+			}
+
+			void scan(const expression_ptr &expr)
+			{
+				if (expr)
+					expr->evaluate(*this);
+			}
+
+		public:
+			virtual void visit(expr_statement &cs)
+			{
+				scan(cs.expr());
+			}
+
+			virtual void visit(let_statement &cs)
+			{
+				scan(cs.expr());
+			}
+
+			virtual void visit(if_statement &is)
+			{
+				for (auto if_stmt = &is; if_stmt != nullptr; if_stmt = if_stmt->next().get())
+				{
+					scan(if_stmt->cond());
+					scan(if_stmt->statement());
+					scan(if_stmt->else_statement());
+				}
+			}
+
+			virtual void visit(def_statement &)
+			{
+				// defining a function doesn't run it.
+			}
+
+			virtual void visit(return_statement &rs)
+			{
+				scan(rs.expr());
+			}
+
+			virtual void visit(while_statement &ws)
+			{
+				scan(ws.cond());
+				scan(ws.block());
+			}
+
+			virtual void visit(for_statement &fs)
+			{
+				scan(fs.init());
+				scan(fs.cond());
+				scan(fs.incr());
+				scan(fs.block());
+			}
+
+			virtual void visit(for_in_statement &fs)
+			{
+				// the source may be a generator, resuming it runs script.
+				opaque = true;
+				scan(fs.source());
+				scan(fs.block());
+			}
+
+			virtual void visit(yield_statement &ys)
+			{
+				opaque = true;
+				scan(ys.expr());
+			}
+
+			virtual void visit(block_statement &bs)
+			{
+				for (const auto &stmt : bs.statements())
+					scan(stmt);
+			}
+
+			virtual void visit(object_definition_statement &)
+			{
+			}
+
+			virtual void visit(import_statement &)
+			{
+				opaque = true;
+			}
+
+			virtual void visit(expression &ex)
+			{
+				if (std::holds_alternative<expression_ptr>(ex.value()))
+					scan(std::get<expression_ptr>(ex.value()));
+			}
+
+			virtual void visit(nary_expression &cs)
+			{
+				switch (cs.op())
+				{
+				case op_type::eq:
+					if (cs.expressions().size() == 2)
+						scan(cs.expressions()[0]);
+					[[fallthrough]]; // the target is written.
+				case op_type::increment:
+				case op_type::decrement:
+				{
+					bool named = false;
+					for (const auto &expr : cs.expressions())
+					{
+						if (expr && std::holds_alternative<identifier>(expr->value()))
+						{
+							writes.insert(std::get<identifier>(expr->value()).name);
+							named = true;
+						}
+					}
+					if (!named)
+						opaque = true;
+					return;
+				}
+				case op_type::func:
+					opaque = true;
+					break;
+				default:
+					break;
+				}
+				for (const auto &expr : cs.expressions())
+					scan(expr);
+			}
+
+			virtual void visit(new_blob_expression &ns)
+			{
+				for (const auto &init : ns.initializers())
+					scan(init.expr);
+			}
+
+			virtual void visit(new_array_expression &nas)
+			{
+				for (const auto &expr : nas.expressions())
+					scan(expr);
+			}
+
+			virtual void visit(new_object_expression &nos)
+			{
+				opaque = true;
+				for (const auto &init : nos.initializers())
+					scan(init.expr);
+			}
+
+			virtual void visit(function_address_expression &)
+			{
+			}
+		};
+	}
+
+	/// <summary>
+	/// Rewrites a syntax tree before it's run. Folds operators whose operands
+	/// are literals, replaces reads of a let whose value is a literal with the
+	/// literal, and drops if branches that can never be taken.
+	///
+	/// Variables are dynamically scoped, so any call could assign any of them;
+	/// a let is only propagated up to the next call, import or assignment.
+	/// </summary>
+	class optimizer : public statement_visitor, public expression_visitor
+	{
+		using constants = std::map<std::string, value_t>;
+
+	public:
+		void optimize(syntax_tree &ast)
+		{
+			constants_.clear();
+			rewrite(ast);
+		}
+
+		void optimize(statement_ptr &stmt)
+		{
+			constants_.clear();
+			rewrite(stmt);
+		}
+
+	public:
+		virtual void visit(expr_statement &cs)
+		{
+			rewrite(cs.expr());
+		}
+
+		virtual void visit(let_statement &cs)
+		{
+			rewrite(cs.expr());
+			if (auto v = literal(cs.expr()))
+				constants_[cs.name()] = *v;
+			else
+				constants_.erase(cs.name());
+		}
+
+		virtual void visit(if_statement &is)
+		{
+			struct branch
+			{
+				expression_ptr cond;
+				statement_ptr body;
+			};
+
+			std::vector<branch> branches;
+			statement_ptr otherwise;
+			bool decided = false;
+			detail::effects taken;
+
+			auto if_stmt = &is;
+			for (; if_stmt != nullptr; if_stmt = if_stmt->next().get())
+			{
+				rewrite(if_stmt->cond());
+				const auto cond = detail::truth(if_stmt->cond());
+				if (cond.has_value() && !cond.value())
+				{
+					if (!if_stmt->next())
+						break;
+					continue;
+				}
+
+				scoped(if_stmt->statement());
+				taken.scan(if_stmt->statement());
+				if (cond.has_value())
+				{
+					// always taken, nothing after it can be.
+					otherwise = std::move(if_stmt->statement());
+					decided = true;
+					break;
+				}
+				branches.push_back(branch{ std::move(if_stmt->cond()), std::move(if_stmt->statement()) });
+				if (!if_stmt->next())
+					break;
+			}
+
+			if (!decided && if_stmt && if_stmt->else_statement())
+			{
+				scoped(if_stmt->else_statement());
+				taken.scan(if_stmt->else_statement());
+				otherwise = std::move(if_stmt->else_statement());
+			}
+			drop(taken);
+
+			if (branches.empty())
+			{
+				// keep the branch in an if so that it still gets its own scope.
+				if (otherwise)
+					replaced_ = std::make_unique<if_statement>(std::make_unique<expression>(value_t{ true }), std::move(otherwise));
+				else
+					replaced_ = std::make_unique<expr_statement>(nullptr);
+				return;
+			}
+
+			auto head = std::make_unique<if_statement>(std::move(branches[0].cond), std::move(branches[0].body));
+			auto tail = head.get();
+			for (size_t i = 1; i < branches.size(); ++i)
+			{
+				tail->next(std::make_unique<if_statement>(std::move(branches[i].cond), std::move(branches[i].body)));
+				tail = tail->next().get();
+			}
+			if (otherwise)
+				tail->else_statement(std::move(otherwise));
+			replaced_ = std::move(head);
+		}
+
+		virtual void visit(def_statement &ds)
+		{
+			// the body runs when it's called, not here.
+			auto outer = std::move(constants_);
+			constants_.clear();
+			rewrite(ds.body());
+			constants_ = std::move(outer);
+		}
+
+		virtual void visit(return_statement &rs)
+		{
+			rewrite(rs.expr());
+		}
+
+		virtual void visit(while_statement &ws)
+		{
+			// the loop runs again after its own assignments.
+			forget(ws);
+			rewrite(ws.cond());
+			scoped(ws.block());
+
+			const auto cond = detail::truth(ws.cond());
+			if (cond.has_value() && !cond.value())
+				replaced_ = std::make_unique<expr_statement>(nullptr);
+		}
+
+		virtual void visit(for_statement &fs)
+		{
+			auto outer = constants_;
+			rewrite(fs.init());
+			forget(fs.cond(), fs.incr(), fs.block());
+			rewrite(fs.cond());
+			scoped(fs.block());
+			rewrite(fs.incr());
+			constants_ = std::move(outer);
+			forget(fs);
+		}
+
+		virtual void visit(for_in_statement &fs)
+		{
+			// each value can come from a generator, which could assign anything.
+			rewrite(fs.source());
+			constants_.clear();
+			scoped(fs.block());
+			constants_.clear();
+		}
+
+		virtual void visit(yield_statement &ys)
+		{
+			// whoever resumes may assign anything meanwhile.
+			rewrite(ys.expr());
+			constants_.clear();
+		}
+
+		virtual void visit(block_statement &bs)
+		{
+			rewrite(bs.statements());
+		}
+
+		virtual void visit(object_definition_statement &)
+		{
+			// member initializers run when an object is made.
+		}
+
+		virtual void visit(import_statement &)
+		{
+			constants_.clear();
+		}
+
+		virtual void visit(expression &ex)
+		{
+			auto &value = ex.value();
+			if (std::holds_alternative<expression_ptr>(value))
+			{
+				auto &inner = std::get<expression_ptr>(value);
+				rewrite(inner);
+				replacement_ = std::move(inner);
+			}
+			else if (std::holds_alternative<identifier>(value))
+			{
+				const auto &id = std::get<identifier>(value);
+				if (!id.path.empty())
+					return;
+				auto found = constants_.find(id.name);
+				if (found != constants_.end())
+					replacement_ = std::make_unique<expression>(found->second);
+			}
+		}
+
+		virtual void visit(nary_expression &cs)
+		{
+			auto &exprs = cs.expressions();
+			switch (cs.op())
+			{
+			case op_type::add:
+				return binary<add_op>(cs);
+			case op_type::sub:
+				return binary<sub_op>(cs);
+			case op_type::mult:
+				return binary<mult_op>(cs);
+			case op_type::div:
+				return binary<div_op>(cs);
+			case op_type::eqeq:
+				return binary<eqeq_op>(cs);
+			case op_type::neq:
+				return binary<neq_op>(cs);
+			case op_type::lt:
+				return binary<lt_op>(cs);
+			case op_type::lteq:
+				return binary<lte_op>(cs);
+			case op_type::gt:
+				return binary<gt_op>(cs);
+			case op_type::gteq:
+				return binary<gte_op>(cs);
+			case op_type::log_and:
+				return logical(cs, false);
+			case op_type::log_or:
+				return logical(cs, true);
+			case op_type::func:
+				for (auto &expr : exprs)
+					rewrite(expr);
+				constants_.clear();
+				return;
+			case op_type::expand:
+				for (auto &expr : exprs)
+					rewrite(expr);
+				return;
+			case op_type::eq:
+				if (exprs.size() == 2)
+					rewrite(exprs[0]);
+				return forget(cs);
+			default:
+				return forget(cs);
+			}
+		}
+
+		virtual void visit(new_blob_expression &ns)
+		{
+			for (auto &init : ns.initializers())
+				rewrite(init.expr);
+		}
+
+		virtual void visit(new_array_expression &nas)
+		{
+			for (auto &expr : nas.expressions())
+				rewrite(expr);
+		}
+
+		virtual void visit(new_object_expression &nos)
+		{
+			for (auto &init : nos.initializers())
+				rewrite(init.expr);
+			constants_.clear();
+		}
+
+		virtual void visit(function_address_expression &)
+		{
+		}
+
+	private:
+		void rewrite(expression_ptr &expr)
+		{
+			if (!expr)
+				return;
+			expr->evaluate(*this);
+			if (replacement_)
+				expr = std::move(replacement_);
+		}
+
+		void rewrite(statement_ptr &stmt)
+		{
+			if (!stmt)
+				return;
+			stmt->evaluate(*this);
+			if (replaced_)
+				stmt = std::move(replaced_);
+		}
+
+		void rewrite(std::vector<statement_ptr> &stmts)
+		{
+			for (auto &stmt : stmts)
+				rewrite(stmt);
+
+			stmts.erase(std::remove_if(stmts.begin(), stmts.end(), [](const statement_ptr &stmt)
+			{
+				auto es = dynamic_cast<const expr_statement *>(stmt.get());
+				return es && !es->expr();
+			}), stmts.end());
+		}
+
+		// a statement with its own scope; its lets go when it ends.
+		void scoped(statement_ptr &stmt)
+		{
+			auto outer = constants_;
+			rewrite(stmt);
+			constants_ = std::move(outer);
+		}
+
+		template <typename OpT>
+		void binary(nary_expression &cs)
+		{
+			auto &exprs = cs.expressions();
+			if (exprs.size() != 2)
+				return forget(cs);
+			rewrite(exprs[1]);
+			rewrite(exprs[0]);
+
+			auto lvalue = literal(exprs[1]);
+			auto rvalue = literal(exprs[0]);
+			if (!lvalue || !rvalue)
+				return;
+			try
+			{
+				replacement_ = std::make_unique<expression>(simpl::apply<OpT>(*lvalue, *rvalue));
+			}
+			catch (const std::exception &)
+			{
+				// leave it to fail when it runs.
+			}
+		}
+
+		// && and || leave the left side if it decides the result, otherwise
+		// the right side.
+		void logical(nary_expression &cs, bool decides)
+		{
+			auto &exprs = cs.expressions();
+			if (exprs.size() != 2)
+				return forget(cs);
+			rewrite(exprs[1]);
+			const auto left = detail::truth(exprs[1]);
+			rewrite(exprs[0]);
+			if (!left.has_value())
+				return;
+			replacement_ = std::move(left.value() == decides ? exprs[1] : exprs[0]);
+		}
+
+		template <typename... NodesT>
+		void forget(NodesT &...nodes)
+		{
+			detail::effects e;
+			(scan(e, nodes), ...);
+			drop(e);
+		}
+
+		void drop(const detail::effects &e)
+		{
+			if (e.opaque)
+				return constants_.clear();
+			for (const auto &name : e.writes)
+				constants_.erase(name);
+		}
+
+		template <typename NodeT>
+		static void scan(detail::effects &e, NodeT &node)
+		{
+			if constexpr (std::is_base_of_v<statement, NodeT> || std::is_base_of_v<expression, NodeT>)
+				node.evaluate(e);
+			else
+				e.scan(node);
+		}
+
+	private:
+		constants constants_;
+		expression_ptr replacement_;
+		statement_ptr replaced_;
+	};
+
+	inline void optimize(syntax_tree &ast)
+	{
+		optimizer o;
+		o.optimize(ast);
+	}
+
+	inline void optimize(statement_ptr &stmt)
+	{
+		optimizer o;
+		o.optimize(stmt);
+	}
+}
+
+#endif // __simpl_optimizer_h__
@@ -2,13 +2,16 @@
 #define __simpl_parser_h__
 
 #include <simpl/cast.h>
+#include <simpl/detail/arena.h>
 #include <simpl/detail/format.h>
 #include <simpl/tokenizer.h>
 #include <simpl/statement.h>
 
+#include <charconv>
 #include <memory>
 #include <stack>
 #include <string>
+#include <string_view>
 #include <vector>
 #include <variant>
 
@@ -29,6 +32,7 @@ namespace simpl
 		while_keyword,
 		return_keyword,
 		object_keyword,
+		yield_keyword,
 		unknown_keyword,
 	};
 
@@ -97,17 +101,31 @@ namespace simpl
 	public:
 
 		parser(const std::string &text)
-			:tokenizer_(text.c_str(), text.c_str() + text.length()), scope_(scopes::main)
+			:tokenizer_(text.c_str(), text.c_str() + text.length()), scope_(scopes::main), arena_(detail::node_arena::create())
 		{
 		}
 
 		parser(const char *begin, const char *end)
-			:tokenizer_(begin, end), scope_(scopes::main)
+			:tokenizer_(begin, end), scope_(scopes::main), arena_(detail::node_arena::create())
 		{
 		}
 
+		// parses on from the start of new text; nodes still go to the arena.
+		void reset(const char *begin, const char *end, const position &pos)
+		{
+			tokenizer_.reset(begin, end, pos);
+			scope_ = scopes::main;
+		}
+
+		const tokenizer_t &tokens() const
+		{
+			return tokenizer_;
+		}
+
 		statement_ptr next()
 		{
+			detail::arena_scope in_arena(arena_.get());
+			in_function_ = false; // a def that failed to parse may have left it.
 			auto t = tokenizer_.next();
 			return parse_statement(t);
 		}
@@ -134,6 +152,8 @@ namespace simpl
 				return parse_for_statement(t);
 			case keywords::return_keyword:
 				return parse_return_statement(t);
+			case keywords::yield_keyword:
+				return parse_yield_statement(t);
 			case keywords::object_keyword:
 				return parse_object_statement(t);
 			default:
@@ -178,7 +198,9 @@ namespace simpl
 			if (tkn.type == token_types::number)
 			{
 				tokenizer_.next();
-				return value_t{ std::stod(tkn.to_string()) };
+				double number = 0;
+				std::from_chars(tkn.begin, tkn.end, number);
+				return value_t{ number };
 			}
 			if (tkn.type == token_types::op && builtins::compare(tkn.begin, tkn.end, "&"))
 			{
@@ -451,11 +473,28 @@ namespace simpl
 			return std::make_unique<while_statement>(std::move(cond), std::move(statement));
 		}
 
-		// for(expr;expr;expr)
+		// for(expr;expr;expr) or for(let name in expr)
 		statement_ptr parse_for_statement(token_t &t)
 		{
 			expect(token_types::lparen);
 			auto lt = tokenizer_.next();
+			if (to_keyword(lt) == keywords::let_keyword)
+			{
+				auto name = tokenizer_.next();
+				const auto in = tokenizer_.peek();
+				if (name.type == token_types::identifier_token && in.type == token_types::identifier_token && std::string_view(in.begin, in.end - in.begin) == "in")
+				{
+					tokenizer_.next();
+					auto source = parse_expression();
+					if (source == nullptr)
+						throw parse_error(tokenizer_.pos(), "expected an expression");
+					expect(token_types::rparen);
+					change_scope sp(*this, scopes::for_);
+					auto block = parse_block_statement();
+					return std::make_unique<for_in_statement>(name.to_string(), std::move(source), std::move(block));
+				}
+				tokenizer_.reverse(name);
+			}
 			auto init = parse_let_statement(lt);
 			auto cond = parse_expression();
 			close_statement();
@@ -467,6 +506,18 @@ namespace simpl
 			return std::make_unique<for_statement>(std::move(init), std::move(cond), std::move(incr), std::move(block));
 		}
 
+		statement_ptr parse_yield_statement(token_t &t)
+		{
+			if (!in_function_)
+				throw parse_error(tokenizer_.pos(), "yield outside a function");
+			auto expr = parse_expression();
+			if (expr == nullptr)
+				throw parse_error(tokenizer_.pos(), "expected an expression");
+			close_statement();
+			yields_ = true;
+			return std::make_unique<yield_statement>(std::move(expr));
+		}
+
 		statement_ptr parse_return_statement(token_t &t)
 		{
 			auto expr = parse_expression();
@@ -516,7 +567,7 @@ namespace simpl
 
 			std::optional<std::string> inherits;
 			auto nxt = tokenizer_.peek();
-			if (nxt.type == token_types::identifier_token && nxt.to_string() == "inherits")
+			if (nxt.type == token_types::identifier_token && nxt.view() == "inherits")
 			{
 				tokenizer_.next(); // consume is-a
 				nxt = expect(token_types::identifier_token);
@@ -575,11 +626,18 @@ namespace simpl
 			auto id_list = parse_argument_list();
 			expect(token_types::rparen);
 			change_scope sp(*this, scopes::function);
+			const auto outer_function = in_function_;
+			const auto outer_yields = yields_;
+			in_function_ = true;
+			yields_ = false;
 			auto block = parse_block_statement();
+			const auto generator = yields_;
+			in_function_ = outer_function;
+			yields_ = outer_yields;
 
 			if (block == nullptr) return nullptr;
 
-			return std::make_unique<def_statement>(identifier.to_string(), std::move(id_list), std::move(block));
+			return std::make_unique<def_statement>(identifier.to_string(), std::move(id_list), std::move(block), generator);
 		}
 
 		std::vector<argument> parse_argument_list()
@@ -759,29 +817,45 @@ namespace simpl
 				throw parse_error(tokenizer_.pos(), "expected a ';'");
 		}
 
+		// switches on the length and first character, then checks the rest.
 		template <typename IteratorT>
 		keywords to_keyword(IteratorT begin, IteratorT end)
 		{
-			if (builtins::compare(begin, end, "if"))
-				return keywords::if_keyword;
-			else if (builtins::compare(begin, end, "else"))
-				return keywords::else_keyword;
-			else if (builtins::compare(begin, end, "is"))
-				return keywords::keyword_is;
-			else if (builtins::compare(begin, end, "def"))
-				return keywords::def_keyword;
-			else if (builtins::compare(begin, end, "new"))
-				return keywords::new_keyword;
-			else if (builtins::compare(begin, end, "let"))
-				return keywords::let_keyword;
-			else if (builtins::compare(begin, end, "while"))
-				return keywords::while_keyword;
-			else if (builtins::compare(begin, end, "for"))
-				return keywords::for_keyword;
-			else if (builtins::compare(begin, end, "return"))
-				return keywords::return_keyword;
-			else if (builtins::compare(begin, end, "object"))
-				return keywords::object_keyword;
+			const std::string_view word(begin, end - begin);
+			switch (word.size())
+			{
+			case 2:
+				if (word == "if")
+					return keywords::if_keyword;
+				if (word == "is")
+					return keywords::keyword_is;
+				break;
+			case 3:
+				switch (word[0])
+				{
+				case 'd': return word == "def" ? keywords::def_keyword : keywords::unknown_keyword;
+				case 'n': return word == "new" ? keywords::new_keyword : keywords::unknown_keyword;
+				case 'l': return word == "let" ? keywords::let_keyword : keywords::unknown_keyword;
+				case 'f': return word == "for" ? keywords::for_keyword : keywords::unknown_keyword;
+				}
+				break;
+			case 4:
+				if (word == "else")
+					return keywords::else_keyword;
+				break;
+			case 5:
+				if (word == "while")
+					return keywords::while_keyword;
+				if (word == "yield")
+					return keywords::yield_keyword;
+				break;
+			case 6:
+				if (word == "return")
+					return keywords::return_keyword;
+				if (word == "object")
+					return keywords::object_keyword;
+				break;
+			}
 			return keywords::unknown_keyword;
 		}
 
@@ -831,11 +905,14 @@ namespace simpl
 	private:
 		tokenizer_t tokenizer_;
 		scopes scope_;
+		bool in_function_ = false; // parsing a def's body
+		bool yields_ = false;      // and it has a yield
+		detail::arena_ref arena_; // the nodes of every statement parsed.
 	};
 
-	inline syntax_tree parse(const std::string &s)
+	inline syntax_tree parse(const char *begin, const char *end)
 	{
-		parser p(s);
+		parser p(begin, end);
 		syntax_tree ast;
 		while (1)
 		{
@@ -845,6 +922,11 @@ namespace simpl
 		}
 		return ast;
 	}
+
+	inline syntax_tree parse(const std::string &s)
+	{
+		return parse(s.c_str(), s.c_str() + s.length());
+	}
 	
 }
 
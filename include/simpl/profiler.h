@@ -0,0 +1,166 @@
+#ifndef __simpl_profiler_h__
+#define __simpl_profiler_h__
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <iomanip>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace simpl
+{
+    /// <summary>
+    /// Samples which script functions a vm is in. A thread ticks every
+    /// interval; the vm notices at its next call, return or loop back edge
+    /// and records its call stack, weighted by the ticks since the last one.
+    /// Until then it only compares two counters. Attach it to one vm with
+    /// vm::profile and read the results once the script is done.
+    /// </summary>
+    class profiler
+    {
+    public:
+        struct entry
+        {
+            std::string function;
+            uint64_t self;  // ticks at the top of the stack
+            uint64_t total; // ticks anywhere on the stack
+        };
+
+        explicit profiler(std::chrono::microseconds interval = std::chrono::milliseconds(1))
+            :interval_(interval), ticks_(0), seen_(0), running_(true)
+        {
+            ticker_ = std::thread([this]()
+            {
+                std::unique_lock<std::mutex> lock(mtx_);
+                while (!cv_.wait_for(lock, interval_, [this]() { return !running_; }))
+                    ticks_.fetch_add(1, std::memory_order_relaxed);
+            });
+        }
+
+        profiler(const profiler &) = delete;
+        profiler &operator=(const profiler &) = delete;
+
+        ~profiler()
+        {
+            stop();
+        }
+
+        void stop()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                running_ = false;
+            }
+            cv_.notify_all();
+            if (ticker_.joinable())
+                ticker_.join();
+        }
+
+        bool due() const
+        {
+            return ticks_.load(std::memory_order_relaxed) != seen_;
+        }
+
+        // records calls, anything with size() and at(i).function, bottom first.
+        template <typename CallstackT>
+        void sample(const CallstackT &calls)
+        {
+            const auto now = ticks_.load(std::memory_order_relaxed);
+            std::vector<std::string> stack;
+            stack.reserve(calls.size());
+            for (size_t i = 0; i < calls.size(); ++i)
+            {
+                const auto &name = calls.at(i).function;
+                stack.push_back(name.empty() ? "main" : name);
+            }
+            stacks_[std::move(stack)] += now - seen_;
+            seen_ = now;
+        }
+
+        std::chrono::microseconds interval() const
+        {
+            return interval_;
+        }
+
+        uint64_t ticks() const
+        {
+            uint64_t ticks = 0;
+            for (const auto &[stack, count] : stacks_)
+                ticks += count;
+            return ticks;
+        }
+
+        // one line per distinct stack, 'main;f;g 12', as flamegraph.pl reads.
+        void write_folded(std::ostream &os) const
+        {
+            for (const auto &[stack, count] : stacks_)
+            {
+                for (size_t i = 0; i < stack.size(); ++i)
+                    os << (i == 0 ? "" : ";") << stack[i];
+                os << " " << count << "\n";
+            }
+        }
+
+        // by self time, most first. A recursive function counts once a tick.
+        std::vector<entry> table() const
+        {
+            std::map<std::string, entry> functions;
+            for (const auto &[stack, count] : stacks_)
+            {
+                std::vector<const std::string *> counted;
+                for (const auto &name : stack)
+                {
+                    if (std::find_if(counted.begin(), counted.end(), [&](const std::string *n) { return *n == name; }) != counted.end())
+                        continue;
+                    counted.push_back(&name);
+                    auto &e = functions.try_emplace(name, entry{ name, 0, 0 }).first->second;
+                    e.total += count;
+                }
+                functions[stack.back()].self += count;
+            }
+
+            std::vector<entry> ret;
+            for (auto &[name, e] : functions)
+                ret.push_back(std::move(e));
+            std::stable_sort(ret.begin(), ret.end(), [](const entry &l, const entry &r) { return l.self > r.self; });
+            return ret;
+        }
+
+        void write_table(std::ostream &os) const
+        {
+            const auto all = std::max<uint64_t>(ticks(), 1);
+            const auto ms = [this](uint64_t ticks) { return ticks * interval_.count() / 1000.0; };
+            os << std::left << std::setw(24) << "function" << std::right
+                << std::setw(12) << "self ms" << std::setw(8) << "self%"
+                << std::setw(12) << "total ms" << std::setw(8) << "total%" << "\n";
+            os << std::fixed << std::setprecision(1);
+            for (const auto &e : table())
+            {
+                os << std::left << std::setw(24) << e.function << std::right
+                    << std::setw(12) << ms(e.self) << std::setw(8) << 100.0 * e.self / all
+                    << std::setw(12) << ms(e.total) << std::setw(8) << 100.0 * e.total / all << "\n";
+            }
+            os << std::defaultfloat;
+        }
+
+    private:
+        const std::chrono::microseconds interval_;
+        std::atomic<uint64_t> ticks_;
+        uint64_t seen_; // only the vm's thread touches this and the stacks.
+        std::map<std::vector<std::string>, uint64_t> stacks_;
+
+        std::mutex mtx_;
+        std::condition_variable cv_;
+        bool running_;
+        std::thread ticker_;
+    };
+}
+
+#endif // __simpl_profiler_h__
@@ -0,0 +1,149 @@
+#ifndef __simpl_program_h__
+#define __simpl_program_h__
+
+#include <simpl/engine.h>
+
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace simpl
+{
+    /// <summary>
+    /// Scripts set up once and then only copied: the types, functions and
+    /// globals of an engine that's done importing and defining. Nothing
+    /// runs in it after, so any number of threads can make engines from
+    /// it at once, each its own vm with its own values and caches over the
+    /// same compiled functions.
+    /// </summary>
+    class program
+    {
+    public:
+        explicit program(const engine &setup)
+            :engine_(setup)
+        {
+        }
+
+        program(const program &) = delete;
+        program &operator=(const program &) = delete;
+
+        std::unique_ptr<engine> instantiate() const
+        {
+            return std::make_unique<engine>(engine_);
+        }
+
+    private:
+        const engine engine_;
+    };
+
+    /// <summary>
+    /// Engines made from a program, handed out one request at a time. An
+    /// engine is used once; when it's returned it's dropped and a fresh one
+    /// made in its place, so requests never see each other's values and
+    /// acquire rarely has to wait on a copy.
+    /// </summary>
+    class engine_pool
+    {
+    public:
+        class lease
+        {
+        public:
+            lease(lease &&rhs) noexcept
+                :pool_(rhs.pool_), engine_(std::move(rhs.engine_))
+            {
+                rhs.pool_ = nullptr;
+            }
+
+            lease(const lease &) = delete;
+            lease &operator=(const lease &) = delete;
+            lease &operator=(lease &&) = delete;
+
+            ~lease()
+            {
+                if (pool_ != nullptr && engine_ != nullptr)
+                    pool_->release();
+            }
+
+            engine &operator*() const
+            {
+                return *engine_;
+            }
+
+            engine *operator->() const
+            {
+                return engine_.get();
+            }
+
+        private:
+            friend class engine_pool;
+
+            lease(engine_pool *pool, std::unique_ptr<engine> e)
+                :pool_(pool), engine_(std::move(e))
+            {
+            }
+
+            engine_pool *pool_;
+            std::unique_ptr<engine> engine_;
+        };
+
+        // keeps up to idle engines ready.
+        engine_pool(std::shared_ptr<const program> prog, size_t idle)
+            :program_(std::move(prog)), idle_(idle)
+        {
+            for (size_t i = 0; i < idle_; ++i)
+                ready_.push_back(program_->instantiate());
+        }
+
+        engine_pool(const engine_pool &) = delete;
+        engine_pool &operator=(const engine_pool &) = delete;
+
+        lease acquire()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                if (!ready_.empty())
+                {
+                    auto e = std::move(ready_.back());
+                    ready_.pop_back();
+                    return lease(this, std::move(e));
+                }
+            }
+            return lease(this, program_->instantiate());
+        }
+
+        // engines ready to be acquired.
+        size_t ready() const
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            return ready_.size();
+        }
+
+        const std::shared_ptr<const program> &source() const
+        {
+            return program_;
+        }
+
+    private:
+        // the returned engine is dropped by its lease, this tops up.
+        void release()
+        {
+            {
+                std::lock_guard<std::mutex> lock(mtx_);
+                if (ready_.size() >= idle_)
+                    return;
+            }
+            auto e = program_->instantiate();
+            std::lock_guard<std::mutex> lock(mtx_);
+            if (ready_.size() < idle_)
+                ready_.push_back(std::move(e));
+        }
+
+    private:
+        std::shared_ptr<const program> program_;
+        const size_t idle_;
+        mutable std::mutex mtx_;
+        std::vector<std::unique_ptr<engine>> ready_;
+    };
+}
+
+#endif // __simpl_program_h__
@@ -0,0 +1,184 @@
+#ifndef __simpl_segmented_stack_h__
+#define __simpl_segmented_stack_h__
+
+#include <memory>
+#include <new>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace simpl
+{
+    namespace detail
+    {
+        // A stack that grows a segment at a time up to a limit. Elements never
+        // move once pushed, so pointers to them stay good until they're popped.
+        // Segments are kept when the stack shrinks, to be reused.
+        template <typename T, size_t SegmentBits = 6>
+        class segmented_stack
+        {
+            static constexpr size_t Segment_Size = size_t{ 1 } << SegmentBits;
+            static constexpr size_t Segment_Mask = Segment_Size - 1;
+
+            using slot_t = std::aligned_storage_t<sizeof(T), alignof(T)>;
+
+        public:
+            explicit segmented_stack(size_t limit = 1024)
+                :sptr_(0), limit_(limit), high_water_(0)
+            {
+            }
+
+            segmented_stack(const segmented_stack &) = delete;
+            segmented_stack &operator=(const segmented_stack &) = delete;
+
+            ~segmented_stack()
+            {
+                pop(sptr_);
+            }
+
+            T& push(const T &v)
+            {
+                auto p = new (next()) T(v);
+                grow();
+                return *p;
+            }
+
+            T& push(T &&v)
+            {
+                auto p = new (next()) T(std::move(v));
+                grow();
+                return *p;
+            }
+
+            void pop(size_t s=1)
+            {
+                if (s > sptr_)
+                    throw std::runtime_error("stack underflow");
+
+                if constexpr (std::is_trivially_destructible_v<T>)
+                {
+                    sptr_ -= s;
+                }
+                else
+                {
+                    while (s > 0)
+                    {
+                        slot(--sptr_)->~T();
+                        --s;
+                    }
+                }
+            }
+
+            T &top()
+            {
+                return offset(0);
+            }
+
+            const T &top() const
+            {
+                return offset(0);
+            }
+
+            T &offset(size_t s)
+            {
+                auto idx = s + 1;
+                if (idx > sptr_)
+                    throw std::runtime_error("stack underflow");
+                return *slot(sptr_ - idx);
+            }
+
+            const T &offset(size_t s) const
+            {
+                auto idx = s + 1;
+                if (idx > sptr_)
+                    throw std::runtime_error("stack underflow");
+                return *slot(sptr_ - idx);
+            }
+
+            // indexed from the bottom of the stack.
+            T &at(size_t i)
+            {
+                if (i >= sptr_)
+                    throw std::runtime_error("stack underflow");
+                return *slot(i);
+            }
+
+            const T &at(size_t i) const
+            {
+                if (i >= sptr_)
+                    throw std::runtime_error("stack underflow");
+                return *slot(i);
+            }
+
+            bool empty() const
+            {
+                return sptr_ == 0;
+            }
+
+            size_t size() const
+            {
+                return sptr_;
+            }
+
+            size_t limit() const
+            {
+                return limit_;
+            }
+
+            void limit(size_t limit)
+            {
+                if (limit < sptr_)
+                    throw std::runtime_error("stack limit is below the current size");
+                limit_ = limit;
+            }
+
+            // the deepest the stack has been.
+            size_t high_water() const
+            {
+                return high_water_;
+            }
+
+            // segments allocated, in elements.
+            size_t capacity() const
+            {
+                return segments_.size() * Segment_Size;
+            }
+
+        private:
+            // storage for the next element.
+            void *next()
+            {
+                if (sptr_ >= limit_)
+                    throw std::runtime_error("stack overflow");
+                if (sptr_ == capacity())
+                    segments_.emplace_back(new slot_t[Segment_Size]);
+                return &segments_[sptr_ >> SegmentBits][sptr_ & Segment_Mask];
+            }
+
+            void grow()
+            {
+                if (++sptr_ > high_water_)
+                    high_water_ = sptr_;
+            }
+
+            T *slot(size_t i)
+            {
+                return std::launder(reinterpret_cast<T *>(&segments_[i >> SegmentBits][i & Segment_Mask]));
+            }
+
+            const T *slot(size_t i) const
+            {
+                return std::launder(reinterpret_cast<const T *>(&segments_[i >> SegmentBits][i & Segment_Mask]));
+            }
+
+        private:
+            std::vector<std::unique_ptr<slot_t[]>> segments_;
+            size_t sptr_;
+            size_t limit_;
+            size_t high_water_;
+        };
+    }
+}
+
+#endif //__simpl_segmented_stack_h__
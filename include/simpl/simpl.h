@@ -1,10 +1,15 @@
 #ifndef __simpl_h__
 #define __simpl_h__
 
+#include <simpl/dump.h>
 #include <simpl/evaluate.h>
 #include <simpl/tokenizer.h>
 #include <simpl/parser.h>
+#include <simpl/source.h>
+#include <simpl/module_cache.h>
 #include <simpl/engine.h>
+#include <simpl/program.h>
+#include <simpl/profiler.h>
 #include <simpl/script.h>
 
 
@@ -0,0 +1,277 @@
+#ifndef __simpl_source_h__
+#define __simpl_source_h__
+
+#include <simpl/detail/format.h>
+#include <simpl/parser.h>
+
+#include <algorithm>
+#include <filesystem>
+#include <istream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace simpl
+{
+	/// <summary>
+	/// Read only script text. A file is mapped into memory where the
+	/// platform allows it, so the parser reads the pages directly rather
+	/// than a copy; otherwise the text is held in a string.
+	/// </summary>
+	class source_buffer
+	{
+	public:
+		source_buffer() = default;
+
+		explicit source_buffer(std::string text)
+			:text_(std::move(text))
+		{
+			data_ = text_.data();
+			size_ = text_.size();
+		}
+
+		source_buffer(source_buffer &&rhs) noexcept
+		{
+			*this = std::move(rhs);
+		}
+
+		source_buffer &operator=(source_buffer &&rhs) noexcept
+		{
+			std::swap(text_, rhs.text_);
+			std::swap(data_, rhs.data_);
+			std::swap(size_, rhs.size_);
+			std::swap(mapped_, rhs.mapped_);
+			if (!mapped_)
+				data_ = text_.data();
+			if (!rhs.mapped_)
+				rhs.data_ = rhs.text_.data();
+			return *this;
+		}
+
+		source_buffer(const source_buffer &) = delete;
+		source_buffer &operator=(const source_buffer &) = delete;
+
+		~source_buffer()
+		{
+			unmap();
+		}
+
+		static source_buffer map(const std::filesystem::path &path)
+		{
+			source_buffer sb;
+#ifdef _WIN32
+			HANDLE file = ::CreateFileW(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+			if (file == INVALID_HANDLE_VALUE)
+				throw std::runtime_error(detail::format("cannot open '{0}'", path.string()));
+			LARGE_INTEGER size{};
+			::GetFileSizeEx(file, &size);
+			if (size.QuadPart > 0)
+			{
+				HANDLE mapping = ::CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+				if (mapping != nullptr)
+				{
+					sb.data_ = static_cast<const char *>(::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+					::CloseHandle(mapping);
+				}
+				if (sb.data_ == nullptr)
+				{
+					::CloseHandle(file);
+					throw std::runtime_error(detail::format("cannot map '{0}'", path.string()));
+				}
+				sb.size_ = static_cast<size_t>(size.QuadPart);
+				sb.mapped_ = true;
+			}
+			::CloseHandle(file);
+#else
+			const int fd = ::open(path.c_str(), O_RDONLY);
+			if (fd < 0)
+				throw std::runtime_error(detail::format("cannot open '{0}'", path.string()));
+			struct stat st{};
+			if (::fstat(fd, &st) == 0 && st.st_size > 0)
+			{
+				void *p = ::mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+				if (p == MAP_FAILED)
+				{
+					::close(fd);
+					throw std::runtime_error(detail::format("cannot map '{0}'", path.string()));
+				}
+				sb.data_ = static_cast<const char *>(p);
+				sb.size_ = static_cast<size_t>(st.st_size);
+				sb.mapped_ = true;
+			}
+			::close(fd);
+#endif
+			return sb;
+		}
+
+		const char *begin() const
+		{
+			return data_;
+		}
+
+		const char *end() const
+		{
+			return data_ + size_;
+		}
+
+		size_t size() const
+		{
+			return size_;
+		}
+
+		std::string_view view() const
+		{
+			return std::string_view(data_, size_);
+		}
+
+		bool mapped() const
+		{
+			return mapped_;
+		}
+
+	private:
+		void unmap()
+		{
+			if (!mapped_)
+				return;
+#ifdef _WIN32
+			::UnmapViewOfFile(data_);
+#else
+			::munmap(const_cast<char *>(data_), size_);
+#endif
+			mapped_ = false;
+		}
+
+	private:
+		std::string text_;
+		const char *data_ = text_.data();
+		size_t size_ = 0;
+		bool mapped_ = false;
+	};
+
+	inline syntax_tree parse(const source_buffer &source)
+	{
+		return parse(source.begin(), source.end());
+	}
+
+	/// <summary>
+	/// Parses statements from a stream as the text arrives, e.g. from a pipe.
+	/// Each read waits for a line at most, then takes whatever else the
+	/// stream has ready, up to chunk_size; text is dropped once the
+	/// statements in it are parsed. A statement that reaches the end of
+	/// what's been read is parsed again with more, so one split across reads
+	/// or followed by an else in the next comes out whole. Each retry of the
+	/// same statement waits for twice the lines the last did, which keeps a
+	/// long one from being parsed again for every line.
+	/// </summary>
+	class stream_parser
+	{
+	public:
+		explicit stream_parser(std::istream &is, size_t chunk_size = 64 * 1024)
+			:is_(is), chunk_size_(chunk_size), offset_(0), lines_(1), pos_(1, 1), done_(false), parser_(nullptr, nullptr)
+		{
+		}
+
+		// nullptr at the end of the stream.
+		statement_ptr next()
+		{
+			while (true)
+			{
+				const auto begin = buffer_.data() + offset_;
+				parser_.reset(begin, buffer_.data() + buffer_.size(), pos_);
+				try
+				{
+					auto stmt = parser_.next();
+					if (done_ || !parser_.tokens().exhausted())
+					{
+						offset_ = parser_.tokens().mark() - buffer_.data();
+						pos_ = parser_.tokens().mark_pos();
+						lines_ = 1;
+						return stmt;
+					}
+				}
+				catch (const token_error &)
+				{
+					if (done_ || !parser_.tokens().exhausted())
+						throw;
+				}
+				catch (const parse_error &)
+				{
+					if (done_ || !parser_.tokens().exhausted())
+						throw;
+				}
+				fill();
+				lines_ *= 2;
+			}
+		}
+
+		// characters read and not parsed yet.
+		size_t buffered() const
+		{
+			return buffer_.size() - offset_;
+		}
+
+	private:
+		void fill()
+		{
+			// drop what's been parsed before reading more, and start a new
+			// arena so the old one goes once its statements do.
+			buffer_.erase(0, offset_);
+			offset_ = 0;
+			parser_ = parser(nullptr, nullptr);
+
+			// lines_ lines, which a pipe hands over as soon as they're written.
+			// get fails on an empty line, that's only the end if the stream is.
+			const auto size = buffer_.size();
+			buffer_.resize(size + chunk_size_ + 1);
+			size_t read = 0;
+			for (size_t line = 0; line < lines_ && read < chunk_size_ && !is_.eof(); ++line)
+			{
+				is_.get(&buffer_[size + read], static_cast<std::streamsize>(chunk_size_ - read + 1), '\n');
+				read += static_cast<size_t>(is_.gcount());
+				if (is_.fail() && !is_.eof())
+					is_.clear();
+				if (read < chunk_size_ && is_.peek() == '\n')
+					buffer_[size + read++] = static_cast<char>(is_.get());
+			}
+
+			// then what's ready without waiting.
+			while (read < chunk_size_)
+			{
+				const auto ready = is_.rdbuf()->in_avail();
+				if (ready <= 0)
+					break;
+				is_.read(&buffer_[size + read], static_cast<std::streamsize>(std::min(static_cast<size_t>(ready), chunk_size_ - read)));
+				read += static_cast<size_t>(is_.gcount());
+			}
+			buffer_.resize(size + read);
+			if (read == 0)
+				done_ = true;
+		}
+
+	private:
+		std::istream &is_;
+		const size_t chunk_size_;
+		std::string buffer_;
+		size_t offset_;
+		size_t lines_;
+		position pos_;
+		bool done_;
+		parser parser_;
+	};
+}
+
+#endif // __simpl_source_h__
@@ -22,6 +22,8 @@ namespace simpl
 	class return_statement;
 	class while_statement;
 	class for_statement;
+	class for_in_statement;
+	class yield_statement;
 	class block_statement;
 	class object_definition_statement;
 	class import_statement;
@@ -37,6 +39,8 @@ namespace simpl
 		virtual void visit(return_statement &rs) = 0;
 		virtual void visit(while_statement &ws) = 0;
 		virtual void visit(for_statement &fs) = 0;
+		virtual void visit(for_in_statement &fs) = 0;
+		virtual void visit(yield_statement &ys) = 0;
 		virtual void visit(block_statement &bs) = 0;
 		virtual void visit(object_definition_statement &os) = 0;
 		virtual void visit(import_statement& is) = 0;
@@ -46,6 +50,17 @@ namespace simpl
 	{
 		virtual ~statement() {};
 		virtual void evaluate(statement_visitor &v) = 0;
+
+		// nodes made while parsing come from the parse's arena.
+		static void *operator new(size_t size)
+		{
+			return detail::node_arena::allocate(size);
+		}
+
+		static void operator delete(void *p)
+		{
+			detail::node_arena::deallocate(p);
+		}
 	};
 
 	using statement_ptr = std::unique_ptr<statement>;
@@ -69,6 +84,10 @@ namespace simpl
 		{
 			return expr_;
 		}
+		expression_ptr &expr()
+		{
+			return expr_;
+		}
 	};
 	/// <summary>
 	/// let {identifier} = {expression}[;]
@@ -95,6 +114,10 @@ namespace simpl
 		{
 			return expr_;
 		}
+		expression_ptr &expr()
+		{
+			return expr_;
+		}
 	};
 
 	class if_statement : public statement
@@ -118,15 +141,27 @@ namespace simpl
 		{
 			return doif_;
 		}
+		statement_ptr &statement()
+		{
+			return doif_;
+		}
 		const expression_ptr &cond() const
 		{
 			return cond_;
 		}
+		expression_ptr &cond()
+		{
+			return cond_;
+		}
 
 		const std::unique_ptr<if_statement> &next() const
 		{
 			return next_;
 		}
+		std::unique_ptr<if_statement> &next()
+		{
+			return next_;
+		}
 
 		void next(std::unique_ptr<if_statement> next)
 		{
@@ -137,6 +172,10 @@ namespace simpl
 		{
 			return else_;
 		}
+		statement_ptr &else_statement()
+		{
+			return else_;
+		}
 
 		void else_statement(statement_ptr else_st)
 		{
@@ -164,6 +203,10 @@ namespace simpl
 		{
 			return statements_;
 		}
+		std::vector<statement_ptr> &statements()
+		{
+			return statements_;
+		}
 
 	};
 
@@ -171,8 +214,8 @@ namespace simpl
 	{
 
 	public:
-		def_statement(const std::string &name, std::vector<argument> &&id_list, statement_ptr statement)
-			:name_(name), arguments_(std::move(id_list)), statement_(std::move(statement))
+		def_statement(const std::string &name, std::vector<argument> &&id_list, statement_ptr statement, bool generator = false)
+			:name_(name), arguments_(std::move(id_list)), statement_(std::move(statement)), generator_(generator)
 		{
 		}
 
@@ -191,15 +234,31 @@ namespace simpl
 			return arguments_;
 		}
 
+		const statement_ptr &body() const
+		{
+			return statement_;
+		}
+		statement_ptr &body()
+		{
+			return statement_;
+		}
+
 		statement_ptr release_statement()
 		{
 			return std::move(statement_);
 		}
 
+		// the body yields, a call makes a generator rather than running it.
+		bool generator() const
+		{
+			return generator_;
+		}
+
 	private:
 		std::string name_;
 		std::vector<argument> arguments_;
 		statement_ptr statement_;
+		bool generator_;
 	};
 
 	class while_statement : public statement
@@ -217,10 +276,18 @@ namespace simpl
 		{
 			return cond_;
 		}
+		expression_ptr &cond()
+		{
+			return cond_;
+		}
 		const statement_ptr &block() const
 		{
 			return block_;
 		}
+		statement_ptr &block()
+		{
+			return block_;
+		}
 
 	private:
 		expression_ptr cond_;
@@ -242,11 +309,79 @@ namespace simpl
 		{
 			return expr_;
 		}
+		expression_ptr &expr()
+		{
+			return expr_;
+		}
 	private:
 		expression_ptr expr_;
 
 	};
 
+	// yield expr; hands a value to whoever resumed the generator.
+	class yield_statement : public statement
+	{
+	public:
+		yield_statement(expression_ptr expr)
+			:expr_(std::move(expr))
+		{
+		}
+		virtual void evaluate(statement_visitor &v) override
+		{
+			v.visit(*this);
+		}
+		const expression_ptr &expr() const
+		{
+			return expr_;
+		}
+		expression_ptr &expr()
+		{
+			return expr_;
+		}
+	private:
+		expression_ptr expr_;
+	};
+
+	// for (let name in source) runs block once for each value of an array
+	// or generator.
+	class for_in_statement : public statement
+	{
+	public:
+		for_in_statement(const std::string &name, expression_ptr source, statement_ptr block)
+			:name_(name), source_(std::move(source)), block_(std::move(block))
+		{
+		}
+		virtual void evaluate(statement_visitor &v) override
+		{
+			v.visit(*this);
+		}
+		const std::string &name() const
+		{
+			return name_;
+		}
+		const expression_ptr &source() const
+		{
+			return source_;
+		}
+		expression_ptr &source()
+		{
+			return source_;
+		}
+		const statement_ptr &block() const
+		{
+			return block_;
+		}
+		statement_ptr &block()
+		{
+			return block_;
+		}
+
+	private:
+		std::string name_;
+		expression_ptr source_;
+		statement_ptr block_;
+	};
+
 	class for_statement : public statement
 	{
 	public:
@@ -262,21 +397,37 @@ namespace simpl
 		{
 			return init_;
 		}
+		statement_ptr &init()
+		{
+			return init_;
+		}
 		
 		const expression_ptr &cond() const
 		{
 			return cond_;
 		}
+		expression_ptr &cond()
+		{
+			return cond_;
+		}
 
 		const expression_ptr &incr() const
 		{
 			return incr_;
 		}
+		expression_ptr &incr()
+		{
+			return incr_;
+		}
 
 		const statement_ptr &block() const
 		{
 			return block_;
 		}
+		statement_ptr &block()
+		{
+			return block_;
+		}
 
 	private:
 		statement_ptr init_;
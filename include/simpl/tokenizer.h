@@ -3,9 +3,12 @@
 
 #include <simpl/op.h>
 #include <simpl/detail/format.h>
+#include <simpl/detail/scan.h>
 
+#include <algorithm>
 #include <stdexcept>
 #include <sstream>
+#include <string_view>
 
 namespace simpl
 {
@@ -83,6 +86,12 @@ namespace simpl
 		{ 
 			return std::string(begin, end);
 		}
+
+		// a view of the source, it's only good as long as the source is.
+		std::basic_string_view<CharT> view() const
+		{
+			return std::basic_string_view<CharT>(begin, end - begin);
+		}
 	};
 
 	template <typename CharT>
@@ -94,13 +103,13 @@ namespace simpl
 	public:
 
 		basic_tokenizer(const std::basic_string<CharT> &text)
-			:begin_(&text[0]), end_(&text[text.length()]), cur_(begin_), position_(1, 1)
+			:begin_(&text[0]), end_(&text[text.length()]), cur_(begin_), position_(1, 1), peek_from_(begin_), peek_pos_(1, 1)
 		{
 		}
 
 		template<typename IteratorT>
 		basic_tokenizer(IteratorT begin,  IteratorT end)
-			:begin_(begin), end_(end), cur_(begin),position_(1,1)
+			:begin_(begin), end_(end), cur_(begin),position_(1,1), peek_from_(begin), peek_pos_(1, 1)
 		{
 		}
 
@@ -109,16 +118,27 @@ namespace simpl
 			if (next_.type != token_types::empty_token)
 				return next_;
 
+			peek_from_ = cur_;
+			peek_pos_ = position_;
+
 			auto start = cur_;
 			for (; cur_ < end_; ++cur_, ++position_.col)
 			{
 				char c = *cur_;
-				if (isspace(c))
+				if (c == ' ' || c == '\t')
+				{
+					// the loop steps over the last one.
+					const auto blank_end = detail::scan::skip_blanks(cur_, end_);
+					position_.col += blank_end - cur_ - 1;
+					cur_ = blank_end - 1;
+					continue;
+				}
+				else if (isspace(c))
 				{
 					if (is_eol(c) && scan_eol())
 					{
 						++position_.line;
-						position_.col = 1;
+						position_.col = 0; // the loop steps onto column 1.
 					}
 					continue;
 				}
@@ -225,20 +245,42 @@ namespace simpl
 			return position_;
 		}
 
+		// starts over on new text, counting positions on from pos.
+		void reset(const CharT *begin, const CharT *end, const position &pos)
+		{
+			begin_ = cur_ = peek_from_ = begin;
+			end_ = end;
+			position_ = peek_pos_ = pos;
+			next_ = token_t();
+		}
+
+		// where the text not consumed yet starts, a peeked token isn't.
+		const CharT *mark() const
+		{
+			return next_.type == token_types::empty_token ? cur_ : peek_from_;
+		}
+
+		position mark_pos() const
+		{
+			return next_.type == token_types::empty_token ? position_ : peek_pos_;
+		}
+
+		// scanning has reached the end of the text.
+		bool exhausted() const
+		{
+			return cur_ == end_;
+		}
+
 	private:
 		bool scan_identifier(token_t &t)
 		{
 			auto start = cur_;
-			for (;cur_ != end_; ++cur_)
-			{
-				char c = *cur_;
-				if (!isalnum(c) && c != '_')
-					break;
-			}
+			cur_ = detail::scan::skip_identifier(cur_, end_);
 
 			t.type = token_types::identifier_token;
 			t.begin = start;
 			t.end = cur_;
+			t.pos = advance(start);
 
 			return true;
 		}
@@ -255,6 +297,7 @@ namespace simpl
 			t.type = token_types::number;
 			t.begin = start;
 			t.end = cur_;
+			t.pos = advance(start);
 
 			return true;
 		}
@@ -262,49 +305,60 @@ namespace simpl
 		bool scan_op(token_t &t)
 		{
 			auto start = cur_;
-			for (++cur_; cur_ != end_; ++cur_)
-			{
-				if (is_op_maybe(start, cur_))
-					continue;
-				// If it's not an op, we went one too far ahead so we need to backtrack.
-				if (!is_op(start, cur_))
-					--cur_;
-				break;					
-			}
+			cur_ += op_length(start, end_);
 
 			t.type = token_types::op;
 			t.begin = start;
 			t.end = cur_;
+			t.pos = advance(start);
 			return true;
 		}
 
 		bool scan_comment(token_t &t)
 		{
-			while (!is_eol(*cur_) && cur_ != end_) ++cur_;
+			// stop short of the end of line, so the loop counts it.
+			auto start = cur_;
+			cur_ = detail::scan::find_eol(cur_, end_) - 1;
+			advance(start);
 			return true;
 		}
 
 		bool scan_literal(token_t &t)
 		{
-			++cur_;
+			const auto quote = cur_++;
 			auto start = cur_;
-			for (;cur_ != end_; ++cur_)
-			{
-				char c = *cur_;
-				if (c == '\"')
-					break;
-			}
+			cur_ = detail::scan::find(cur_, end_, CharT('\"'));
 
-			if (cur_ == end_ || *cur_ != '\"')
+			if (cur_ == end_)
 				throw token_error(position_,"missing closing quote");
 
 			t.type = token_types::literal;
 			t.begin = start;
 			t.end = cur_++;
+			t.pos = position_;
+
+			// a literal can run over lines.
+			const auto lines = std::count(start, t.end, CharT('\n'));
+			if (lines == 0)
+			{
+				advance(quote);
+				return true;
+			}
+			position_.line += lines;
+			position_.col = 1;
+			advance(std::find(std::make_reverse_iterator(t.end), std::make_reverse_iterator(start), CharT('\n')).base());
 
 			return true;
 		}
 
+		// moves the column over [from, cur_), returns where it started.
+		position advance(const CharT *from)
+		{
+			const auto at = position_;
+			position_.col += cur_ - from;
+			return at;
+		}
+
 		bool scan_eol()
 		{
 			if (*cur_ == '\r' && cur_ + 1 != end_ && *(cur_ + 1) == '\n')
@@ -323,6 +377,8 @@ namespace simpl
 		const CharT *begin_, *end_, *cur_;
 		position position_;
 		token_t next_;
+		const CharT *peek_from_; // where the peeked token's scan started.
+		position peek_pos_;
 
 	};
 
@@ -5,9 +5,16 @@
 #include <memory>
 #include <stdexcept>
 #include <string>
+#include <type_traits>
+#include <utility>
 #include <variant>
 #include <vector>
 
+#include <simpl/detail/blob_map.h>
+#include <simpl/detail/format.h>
+#include <simpl/detail/nan_box.h>
+#include <simpl/detail/shape.h>
+#include <simpl/detail/shared_string.h>
 #include <simpl/detail/type_traits.h>
 #include <simpl/object.h>
 
@@ -34,10 +41,124 @@ namespace simpl
 
 	using arrayref_t = std::shared_ptr<array_t>;
 
-	using value_t = std::variant<empty_t, bool, double, std::string, blobref_t, arrayref_t, objectref_t>;
+#ifdef SIMPL_NAN_BOXING
+    using value_t = detail::nan_box<empty_t, blobref_t, arrayref_t, objectref_t>;
+#else
+	using value_t = std::variant<empty_t, bool, double, detail::shared_string, blobref_t, arrayref_t, objectref_t>;
+#endif
     using value = value_t;
 
-	struct blob_t { std::map<std::string, value_t> values; };
+    namespace detail
+    {
+        // the alternative of value_t that holds a T.
+        template <typename T>
+        struct stored
+        {
+            using type = T;
+        };
+
+#ifndef SIMPL_NAN_BOXING
+        template <>
+        struct stored<std::string>
+        {
+            using type = shared_string;
+        };
+#endif
+
+        // whether a T is read out of a value_t as a copy rather than a reference.
+#ifdef SIMPL_NAN_BOXING
+        template <typename T>
+        constexpr bool by_value = value_t::by_value<std::remove_const_t<T>>;
+#else
+        template <typename T>
+        constexpr bool by_value = false;
+#endif
+
+        template <typename T>
+        using value_ref_t = std::conditional_t<by_value<T>, std::remove_const_t<T>, T &>;
+    }
+
+    // Access to a value_t that works for either representation; use these
+    // rather than std::get and friends. Strings are read as std::string
+    // either way, reading one through a non-const value_t unshares it.
+    // Boxed bools and numbers are returned by value, so set them by
+    // assigning a value_t rather than through get.
+    template <typename T>
+    bool holds(const value_t &v)
+    {
+#ifdef SIMPL_NAN_BOXING
+        return v.index() == value_t::index_of<T>();
+#else
+        return std::holds_alternative<typename detail::stored<T>::type>(v);
+#endif
+    }
+
+    template <typename T>
+    decltype(auto) get(value_t &v)
+    {
+#ifdef SIMPL_NAN_BOXING
+        return v.template get<T>();
+#else
+        if constexpr (std::is_same_v<T, std::string>)
+            return std::get<detail::shared_string>(v).mutate();
+        else
+            return std::get<T>(v);
+#endif
+    }
+
+    template <typename T>
+    decltype(auto) get(const value_t &v)
+    {
+#ifdef SIMPL_NAN_BOXING
+        return v.template get<T>();
+#else
+        if constexpr (std::is_same_v<T, std::string>)
+            return std::get<detail::shared_string>(v).str();
+        else
+            return std::get<T>(v);
+#endif
+    }
+
+    template <typename VisitorT, typename ValueT, typename = std::enable_if_t<std::is_same_v<std::decay_t<ValueT>, value_t>>>
+    decltype(auto) visit(VisitorT &&visitor, ValueT &&v)
+    {
+#ifdef SIMPL_NAN_BOXING
+        switch (v.index())
+        {
+        case value_t::empty_index:
+            return visitor(v.template get<empty_t>());
+        case value_t::bool_index:
+        {
+            auto b = v.template get<bool>();
+            return visitor(b);
+        }
+        case value_t::number_index:
+        {
+            auto d = v.template get<double>();
+            return visitor(d);
+        }
+        case value_t::string_index:
+            return visitor(std::as_const(v).template get<std::string>());
+        case value_t::blob_index:
+            return visitor(v.template get<blobref_t>());
+        case value_t::array_index:
+            return visitor(v.template get<arrayref_t>());
+        default:
+            return visitor(v.template get<objectref_t>());
+        }
+#else
+        // strings are visited as std::string, read only.
+        return std::visit([&visitor](auto &&alt) -> decltype(auto)
+        {
+            if constexpr (std::is_same_v<std::decay_t<decltype(alt)>, detail::shared_string>)
+                return visitor(alt.str());
+            else
+                return visitor(std::forward<decltype(alt)>(alt));
+        }, std::forward<ValueT>(v));
+#endif
+    }
+
+	struct blob_t { detail::blob_map<value_t> values; };
 	struct array_t 
     {
         array_t() = default;
@@ -51,13 +172,24 @@ namespace simpl
     struct simpl_object_t : simpl::object
     {
         simpl_object_t(const std::string &type)
-            :type_id(type)
+            :simpl_object_t(type, detail::type_ids::intern(type), std::make_shared<detail::shape>())
+        {
+        }
+
+        // for a registered type, whose id is already known.
+        simpl_object_t(const std::string &type, size_t id, std::shared_ptr<const detail::shape> layout)
+            :type_name(type), id(id), shape_(std::move(layout)), slots(shape_->size())
         {
         }
 
         virtual std::string type() const
         {
-            return type_id;
+            return type_name;
+        }
+
+        virtual size_t type_id() const
+        {
+            return id;
         }
 
         virtual bool is_convertible(const std::string &t)
@@ -70,8 +202,38 @@ namespace simpl
             return nullptr;
         }
 
-        const std::string type_id;
-        std::map<std::string, value_t> members;
+        const detail::shape *layout() const
+        {
+            return shape_.get();
+        }
+
+        value_t *member(const std::string &name)
+        {
+            const auto slot = shape_->slot(name);
+            return slot == detail::shape::npos ? nullptr : &slots[slot];
+        }
+
+        // sets a member, adding it if the object doesn't have one by that name.
+        void set_member(const std::string &name, value_t v)
+        {
+            auto slot = shape_->slot(name);
+            if (slot == detail::shape::npos)
+            {
+                shape_ = shape_->with(name);
+                slot = slots.size();
+                slots.emplace_back();
+            }
+            slots[slot] = std::move(v);
+        }
+
+        const std::string type_name;
+        const size_t id;
+
+    private:
+        std::shared_ptr<const detail::shape> shape_;
+
+    public:
+        std::vector<value_t> slots; // indexed by layout().
     };
 
     using instanceref_t = std::shared_ptr<simpl_object_t>;
@@ -91,6 +253,11 @@ namespace simpl
         return std::make_shared<simpl_object_t>(type);
     }
 
+    inline instanceref_t new_simpl_object(const std::string &type, size_t id, std::shared_ptr<const detail::shape> layout)
+    {
+        return std::make_shared<simpl_object_t>(type, id, std::move(layout));
+    }
+
 namespace detail
 {
 
@@ -143,35 +310,85 @@ namespace detail
     // TODO: Use variadics for this, and just used the value_t
     inline std::string get_type_string(const value_t &v)
     {
-        if (std::holds_alternative<empty_t>(v))
+        if (holds<empty_t>(v))
             return "empty";
-        else if (std::holds_alternative<bool>(v))
+        else if (holds<bool>(v))
             return "bool";
-        else if (std::holds_alternative<double>(v))
+        else if (holds<double>(v))
             return "number";
-        else if (std::holds_alternative<std::string>(v))
+        else if (holds<std::string>(v))
             return "string";
-        else if (std::holds_alternative<blobref_t>(v))
+        else if (holds<blobref_t>(v))
             return "blob";
-        else if (std::holds_alternative<arrayref_t>(v))
+        else if (holds<arrayref_t>(v))
             return "array";
-        else if (std::holds_alternative<objectref_t>(v))
+        else if (holds<objectref_t>(v))
         {
-            return std::get<objectref_t>(v)->type();
+            return simpl::get<objectref_t>(v)->type();
         }
 
         throw std::runtime_error("unknown type");
     }
 
+    // the interned type id of a value, see detail::type_ids.
+    inline size_t get_type_id(const value_t &v)
+    {
+        if (holds<objectref_t>(v))
+            return simpl::get<objectref_t>(v)->type_id();
+        return v.index(); // builtin ids match the alternatives.
+    }
+
+    // A copy of v that shares nothing a script can change with it. Blobs,
+    // arrays and script objects are copied once each however often they're
+    // reached, copies remembers them by address; native objects are shared.
+    inline value_t deep_copy(const value_t &v, std::map<const void *, value_t> &copies)
+    {
+        const void *key = nullptr;
+        if (holds<blobref_t>(v))
+            key = simpl::get<blobref_t>(v).get();
+        else if (holds<arrayref_t>(v))
+            key = simpl::get<arrayref_t>(v).get();
+        else if (holds<objectref_t>(v) && simpl::get<objectref_t>(v)->layout() != nullptr)
+            key = simpl::get<objectref_t>(v).get();
+        if (key == nullptr)
+            return v;
+
+        auto found = copies.find(key);
+        if (found != copies.end())
+            return found->second;
+
+        if (holds<blobref_t>(v))
+        {
+            auto blob = std::make_shared<blob_t>(*simpl::get<blobref_t>(v));
+            copies[key] = blob;
+            for (auto &entry : blob->values)
+                entry.second = deep_copy(entry.second, copies);
+            return blob;
+        }
+        if (holds<arrayref_t>(v))
+        {
+            auto arr = std::make_shared<array_t>(*simpl::get<arrayref_t>(v));
+            copies[key] = arr;
+            for (auto &e : arr->values)
+                e = deep_copy(e, copies);
+            return arr;
+        }
+        auto obj = std::make_shared<simpl_object_t>(*static_cast<const simpl_object_t *>(simpl::get<objectref_t>(v).get()));
+        copies[key] = objectref_t{ obj };
+        for (auto &slot : obj->slots)
+            slot = deep_copy(slot, copies);
+        return objectref_t{ obj };
+    }
+
     inline std::optional<std::string> to_builtin_type_string(const std::string &simpl_type)
     {
         return simpl_type;
     }
 
     template <typename T>
-    typename std::enable_if<is_one_of<T, empty_t, bool, double, std::string, objectref_t>::value, T>::type& get_value(value_t &v)
+    std::enable_if_t<is_one_of<T, empty_t, bool, double, std::string, objectref_t>::value, value_ref_t<T>> get_value(value_t &v)
     {
-        return std::get<T>(v);
+        return simpl::get<T>(v);
     }
 
     template<typename T>
@@ -183,30 +400,50 @@ namespace detail
     template<typename T>
     typename std::enable_if<std::is_same_v<T, blob_t>, blob_t>::type &get_value(value_t &v)
     {
-        auto &blobref = std::get<blobref_t>(v);
+        auto &blobref = simpl::get<blobref_t>(v);
         return *blobref;
     }
 
     template<typename T>
     typename std::enable_if<std::is_same_v<T, array_t>, array_t>::type &get_value(value_t &v)
     {
-        auto &arrayref = std::get<arrayref_t>(v);
+        auto &arrayref = simpl::get<arrayref_t>(v);
         return *arrayref;
     }
 
     template <typename T>
-    typename std::enable_if<!is_one_of<T, empty_t, bool, double, std::string, blob_t, array_t, objectref_t, value_t>::value, T>::type& get_value(value_t &v)
+    typename std::enable_if<!std::is_const_v<T> && !is_one_of<T, empty_t, bool, double, std::string, blob_t, array_t, objectref_t, value_t>::value, T>::type& get_value(value_t &v)
     {
-        if (!std::holds_alternative<objectref_t>(v))
+        if (!holds<objectref_t>(v))
             throw std::runtime_error("not an object");
 
-        auto objref = std::get<objectref_t>(v);
+        auto objref = simpl::get<objectref_t>(v);
         if(detail::simple_type_info<T>::name() == objref->type() || objref->is_convertible(detail::simple_type_info<T>::name()))
             return (*reinterpret_cast<T*>(objref->value()));
 
         throw std::runtime_error("bad type conversion");
     }
 
+    // a parameter that can't change its argument reads it where it is, a
+    // shared string isn't copied first.
+    template <typename T>
+    std::enable_if_t<std::is_const_v<T>, value_ref_t<T>> get_value(value_t &v)
+    {
+        if constexpr (std::is_same_v<T, const std::string>)
+            return simpl::get<std::string>(std::as_const(v));
+        else
+            return get_value<std::remove_const_t<T>>(v);
+    }
+
+    // two string values hold the same text.
+    inline bool same_text(const value_t &l, const value_t &r)
+    {
+#ifdef SIMPL_NAN_BOXING
+        return simpl::get<std::string>(l) == simpl::get<std::string>(r);
+#else
+        return std::get<shared_string>(l) == std::get<shared_string>(r);
+#endif
+    }
 }
     struct member_visitor
     {
@@ -228,7 +465,7 @@ namespace detail
         {
             throw std::runtime_error("invalid access");
         }
-        void operator()(std::string &)
+        void operator()(const std::string &)
         {
             throw std::runtime_error("invalid access");
         }
@@ -242,10 +479,11 @@ namespace detail
         }
         void operator()(objectref_t &obj)
         {
-            auto inst = std::dynamic_pointer_cast<simpl_object_t>(obj);
-            if(inst == nullptr)
+            if(obj->layout() == nullptr)
                 throw std::runtime_error("invalid access on type");
-            value = &inst->members.at(member);
+            value = static_cast<simpl_object_t *>(obj.get())->member(member);
+            if(value == nullptr)
+                throw std::runtime_error(detail::format("'{0}' is not a member of '{1}'", member, obj->type()));
         }
         const std::string member;
         value_t *value;
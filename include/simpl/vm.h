@@ -3,23 +3,65 @@
 
 #include <simpl/detail/functional.h>
 #include <simpl/detail/signature.h>
+#include <simpl/detail/stats.h>
 #include <simpl/detail/types.h>
 
+#include <simpl/bytecode.h>
 #include <simpl/cast.h>
 #include <simpl/expression.h>
+#include <simpl/generator.h>
 #include <simpl/library.h>
-#include <simpl/static_stack.h>
+#include <simpl/operations.h>
+#include <simpl/profiler.h>
+#include <simpl/segmented_stack.h>
 #include <simpl/value.h>
 
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
 #include <iostream>
+#include <limits>
 #include <functional>
 #include <map>
+#include <optional>
 #include <stack>
 #include <sstream>
 #include <tuple>
+#include <unordered_map>
 
 namespace simpl
 {
+    // How deep each of a vm's stacks may grow. They only allocate what
+    // they use. Calls the tree walker makes recurse on the thread's own
+    // stack as well, native_stack bounds how much of it they may use.
+    struct vm_limits
+    {
+        size_t stack = 64 * 1024;         // values
+        size_t scopes = 16 * 1024;        // variable scopes
+        size_t calls = 4 * 1024;          // activation records
+        size_t native_stack = 512 * 1024; // bytes, half of the smallest default thread stack
+    };
+
+    // How much a vm may do before it gives up, counted in checkpoints:
+    // function calls and loop back edges.
+    struct work_budget
+    {
+        uint64_t operations = 0; // 0 for any number
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    };
+
+    // Thrown at the checkpoint that runs over a vm's work_budget. The vm is
+    // back where it was before the statement, and stays out of budget until
+    // it's given a new one.
+    class budget_exceeded : public std::runtime_error
+    {
+    public:
+        explicit budget_exceeded(const char *what)
+            :std::runtime_error(what)
+        {
+        }
+    };
+
     class vm
     {
         class var_scope
@@ -40,6 +82,7 @@ namespace simpl
             {
                 std::swap(vm_, rhs.vm_);
                 std::swap(variables_, rhs.variables_);
+                std::swap(locals_, rhs.locals_);
             }
             var_scope &operator=(const var_scope &) = delete;
             var_scope &operator=(var_scope &&rhs) noexcept
@@ -101,6 +144,62 @@ namespace simpl
                 return locals_;
             }
 
+            // whether every variable here is one of names.
+            bool hidden_by(const std::vector<std::string> &names) const
+            {
+                for (const auto &entry : variables_)
+                {
+                    if (std::find(names.begin(), names.end(), entry.first) == names.end())
+                        return false;
+                }
+                return true;
+            }
+
+            // forgets every variable, the values stay where they are.
+            void clear()
+            {
+                variables_.clear();
+                locals_ = 0;
+            }
+
+            // this scope in another vm, each variable at the address moved_to
+            // gives for its old one.
+            template <typename MoveT>
+            var_scope copy_to(vm &to, MoveT &&moved_to) const
+            {
+                var_scope copy(to);
+                for (const auto &[name, v] : variables_)
+                    copy.variables_[name] = moved_to(v);
+                copy.locals_ = locals_;
+                return copy;
+            }
+
+            // this scope of a frame being suspended, each variable by the
+            // slot slots gives for its address.
+            detail::saved_scope save(const std::unordered_map<const value_t *, size_t> &slots) const
+            {
+                detail::saved_scope saved;
+                for (const auto &[name, v] : variables_)
+                {
+                    auto slot = slots.find(v);
+                    if (slot != slots.end())
+                        saved.variables.emplace_back(name, slot->second);
+                }
+                saved.locals = locals_;
+                return saved;
+            }
+
+            // a saved scope back in vm, each variable at address_of its slot.
+            template <typename AddressT>
+            static var_scope restore(vm &vm, const detail::saved_scope &saved, AddressT &&address_of)
+            {
+                var_scope scope(vm);
+                for (const auto &[name, slot] : saved.variables)
+                    scope.variables_[name] = address_of(slot);
+                scope.locals_ = saved.locals;
+                return scope;
+            }
+
         private:
             vm *vm_;
             std::map<std::string, value_t *> variables_;
@@ -127,47 +226,153 @@ namespace simpl
             }
         };
 
+        // an argument is bound to its stack slot, unless the value is boxed
+        // and it has to be copied out.
+        template <typename T>
+        using binding_t = std::conditional_t<detail::by_value<T>, std::remove_const_t<T>, std::reference_wrapper<T>>;
+
         template<size_t N, typename T, typename ...Args>
         struct arg_list<N, T, Args...>
         {
-            static std::tuple<std::reference_wrapper<T>, std::reference_wrapper<Args>...> next(vm &vm)
+            static std::tuple<binding_t<T>, binding_t<Args>...> next(vm &vm)
             {
-                return std::tuple_cat(std::make_tuple(std::ref(detail::get_value<T>(vm.stack_offset(N - 1)))), arg_list<N - 1, Args...>::next(vm));
+                return std::tuple_cat(std::tuple<binding_t<T>>{ detail::get_value<T>(vm.stack_offset(N - 1)) }, arg_list<N - 1, Args...>::next(vm));
             }
         };
 
         template <typename T>
         struct deducer {};
 
+        struct frame
+        {
+            const chunk *code;
+            size_t pc;
+            size_t arity; // arguments to drop once the frame returns
+            size_t base;  // stack index of slot 0
+            chunk_caches *caches;
+        };
+
         template <typename ...Args>
-        std::tuple<std::reference_wrapper<Args>...> load_args(vm &vm, deducer<std::tuple<Args...>>)
+        std::tuple<binding_t<Args>...> load_args(vm &vm, deducer<std::tuple<Args...>>)
         {
             auto args = arg_list<sizeof...(Args), Args...>::next(vm);
             return args;
         }
 
     public:
-        static constexpr size_t Stack_Size = 128;
-        using callstack_t = detail::static_stack<activation_record, Stack_Size>;
-        using stack_t = detail::static_stack<value_t, Stack_Size>;
-        using locals_t = detail::static_stack<var_scope, Stack_Size>;
+        using callstack_t = detail::segmented_stack<activation_record>;
+        using stack_t = detail::segmented_stack<value_t>;
+        using locals_t = detail::segmented_stack<var_scope>;
 
 
     public:
 
-        vm()
-            :functions_(types_)
+        vm(const vm_limits &limits = vm_limits{})
+            :functions_(types_), stack_(limits.stack), locals_(limits.scopes), callstack_(limits.calls), native_limit_(limits.native_stack)
         {
             locals_.push(var_scope{*this}); // global scope.
             callstack_.push(activation_record{}); // main..
         }
 
+        // A copy of a vm, with its types, functions, libraries and globals.
+        // Script values reachable from the globals are copied, so neither vm
+        // sees the other's changes after; compiled functions and types are
+        // immutable and shared. A host function that captured the first vm
+        // still refers to it. Copying a vm that's in a call leaves what's
+        // running behind, the copy is idle. While it's made nothing may
+        // change rhs, though any number of copies may be made at once.
+        vm(const vm &rhs)
+            :types_(rhs.types_), functions_(types_, rhs.functions_), stack_(rhs.stack_.limit()), locals_(rhs.locals_.limit()), callstack_(rhs.callstack_.limit()),
+            native_limit_(rhs.native_limit_), libraries_(rhs.libraries_), globals_(rhs.globals_.size(), nullptr), global_names_(rhs.global_names_), global_ids_(rhs.global_ids_)
+        {
+            // the globals are the bottom of the stack, the rest is running.
+            const auto &global = rhs.locals_.offset(rhs.locals_.size() - 1);
+            std::map<const value_t *, value_t *> moved;
+            std::map<const void *, value_t> copies;
+            for (size_t i = 0; i < global.locals(); ++i)
+                moved[&rhs.stack_.at(i)] = &stack_.push(detail::deep_copy(rhs.stack_.at(i), copies));
+
+            auto moved_to = [&](const value_t *v) -> value_t *
+            {
+                auto found = moved.find(v);
+                return found == moved.end() ? nullptr : found->second;
+            };
+            locals_.push(global.copy_to(*this, moved_to));
+            callstack_.push(activation_record{});
+            for (size_t i = 0; i < rhs.globals_.size(); ++i)
+                globals_[i] = moved_to(rhs.globals_[i]);
+        }
+
+        vm &operator=(const vm &) = delete;
+
+        void set_limits(const vm_limits &limits)
+        {
+            stack_.limit(limits.stack);
+            locals_.limit(limits.scopes);
+            callstack_.limit(limits.calls);
+            native_limit_ = limits.native_stack;
+        }
+
+        // Bounds the work from here until the budget is changed or cleared.
+        // Set one before each evaluation to give each its own.
+        void set_budget(const work_budget &budget)
+        {
+            budget_ = budget;
+            spent_ = 0;
+            window_ = next_window();
+            countdown_ = window_;
+        }
+
+        void clear_budget()
+        {
+            set_budget(work_budget{});
+        }
+
+        const work_budget &budget() const
+        {
+            return budget_;
+        }
+
+        // the checkpoints passed since the budget was set.
+        uint64_t spent() const
+        {
+            return spent_ + (window_ - countdown_);
+        }
+
+        // Counts work done on this vm's behalf elsewhere, in copies of it, as
+        // if it had been checkpoints here. Throws if that's over the budget.
+        void charge(uint64_t operations)
+        {
+            spent_ = spent() + operations;
+            if (budget_.operations != 0 && spent_ >= budget_.operations)
+            {
+                window_ = 1;
+                countdown_ = 1;
+                throw budget_exceeded("operation budget exhausted");
+            }
+            window_ = next_window();
+            countdown_ = window_;
+        }
+
+        // a call or loop back edge, cheap unless a window of them is used up.
+        void checkpoint()
+        {
+            if (--countdown_ == 0)
+                spend();
+        }
+
         void call(const detail::call_def &cd)
         {
             auto fn = functions_.lookup(cd);
+            call(fn);
+        }
+
+        void call(const detail::fn_def *fn)
+        {
+            const native_frame frame(*this);
             activate_function(fn->name, fn->args.size());
             auto sz = callstack_.size();
-            fn->fn();
+            fn->fn(*this);
             // if we run the function, and there's no return, the activation record will still exist
             if (callstack_.size() == sz)
             {
@@ -176,6 +381,203 @@ namespace simpl
             }
         }
 
+        // Statements the compiler leaves as trees are evaluated by this.
+        void fallback(tree_evaluator *evaluator)
+        {
+            fallback_ = evaluator;
+        }
+
+        tree_evaluator *fallback() const
+        {
+            return fallback_;
+        }
+
+        // Samples this vm's call stack into p until it's detached with
+        // nullptr. Copies of the vm aren't profiled.
+        void profile(simpl::profiler *p)
+        {
+            profiler_ = p;
+        }
+
+        tree_evaluator &evaluator()
+        {
+            if (fallback_ == nullptr)
+                throw std::runtime_error("no evaluator for uncompiled statement");
+            return *fallback_;
+        }
+
+        // Runs fn, the stacks go back to how they were if it throws. The
+        // tree walker's statements run in this.
+        template <typename FnT>
+        void unwinding(FnT &&fn)
+        {
+            const auto stack_size = stack_.size();
+            const auto scopes = locals_.size();
+            const auto calls = callstack_.size();
+            try
+            {
+                fn();
+            }
+            catch (...)
+            {
+                unwind_to(stack_size, scopes, calls);
+                throw;
+            }
+        }
+
+        // Runs a compiled top level chunk. It runs once, so its caches go
+        // with it.
+        void execute(const chunk &c)
+        {
+            try
+            {
+                run(c);
+            }
+            catch (...)
+            {
+                caches_.erase(&c);
+                throw;
+            }
+            caches_.erase(&c);
+        }
+
+        // Runs a compiled function body, the activation record is expected
+        // to be in place already, as it is when called through call().
+        void execute_function(const chunk &body)
+        {
+            track_arguments(body);
+            run(body);
+        }
+
+        void define(const function_proto &proto)
+        {
+            auto body = proto.body;
+            if (proto.generator)
+            {
+                // a call doesn't run the body, it makes a generator over it
+                // holding the arguments.
+                reg_fn(detail::fn_def
+                {
+                    proto.id,
+                    proto.name,
+                    proto.arg_types,
+                    [body, name = proto.name](vm &self)
+                    {
+                        std::vector<value_t> args;
+                        for (size_t i = body->arguments.size(); i > 0; --i)
+                            args.push_back(self.stack_offset(i - 1));
+                        self.push_stack(make_ref<generator>(body, name, std::move(args)));
+                        self.return_();
+                    },
+                    nullptr,
+                    {}
+                });
+                return;
+            }
+            reg_fn(detail::fn_def
+            {
+                proto.id,
+                proto.name,
+                proto.arg_types,
+                [body](vm &self)
+                {
+                    self.execute_function(*body);
+                },
+                body,
+                {}
+            });
+        }
+
+        // Runs g on to its next yield and gives what it yields, nothing once
+        // it has returned. Its frame goes back on the stacks for the run and
+        // comes off them again after.
+        std::optional<value_t> resume(generator &g)
+        {
+            if (g.done_)
+                return std::nullopt;
+            if (g.running_)
+                throw std::runtime_error("generator is already running");
+
+            const auto stack_size = stack_.size();
+            const auto scopes = locals_.size();
+            const auto calls = callstack_.size();
+            g.running_ = true;
+            try
+            {
+                stack_.push(value_t{}); // the retval, what it returns is dropped.
+                const auto base = stack_.size();
+                for (auto &v : g.values_)
+                    stack_.push(std::move(v));
+                g.values_.clear();
+                if (g.pc_ == 0)
+                {
+                    enter_scope();
+                    track_arguments(*g.body_);
+                }
+                for (const auto &saved : g.scopes_)
+                    locals_.push(var_scope::restore(*this, saved, [&](size_t slot) { return &stack_.at(base + slot); }));
+                g.scopes_.clear();
+                callstack_.push(activation_record{ g.name_, &stack_.at(base - 1) });
+                counters_.calls.add();
+                sample();
+                checkpoint();
+
+                g.pc_ = run(*g.body_, base, g.pc_);
+                g.running_ = false;
+                if (g.pc_ == 0)
+                {
+                    g.done_ = true;
+                    stack_.pop(stack_.size() - stack_size);
+                    return std::nullopt;
+                }
+
+                value_t yielded = std::move(stack_.top());
+                stack_.pop();
+                std::unordered_map<const value_t *, size_t> slots;
+                for (size_t i = base; i < stack_.size(); ++i)
+                {
+                    slots[&stack_.at(i)] = i - base;
+                    g.values_.push_back(std::move(stack_.at(i)));
+                }
+                for (size_t i = locals_.size() - scopes; i > 0; --i)
+                    g.scopes_.push_back(locals_.offset(i - 1).save(slots));
+                unwind_to(stack_size, scopes, calls);
+                return yielded;
+            }
+            catch (...)
+            {
+                g.running_ = false;
+                g.done_ = true;
+                unwind_to(stack_size, scopes, calls);
+                throw;
+            }
+        }
+
+        // What for in walks: a generator is its own iterator, an array gets
+        // one.
+        value_t make_iterator(const value_t &v)
+        {
+            if (holds<arrayref_t>(v))
+                return make_ref<array_iterator>(array_iterator{ simpl::get<arrayref_t>(v) });
+            if (holds<objectref_t>(v) && dynamic_cast<ref<generator> *>(simpl::get<objectref_t>(v).get()) != nullptr)
+                return v;
+            throw std::runtime_error(detail::format("'{0}' is not iterable", detail::get_type_string(v)));
+        }
+
+        // the next value of an iterator from make_iterator, nothing once
+        // it's through.
+        std::optional<value_t> iterate(const value_t &it)
+        {
+            auto obj = simpl::get<objectref_t>(it).get();
+            if (auto g = dynamic_cast<ref<generator> *>(obj))
+                return resume(*static_cast<generator *>(g->value()));
+
+            auto &ai = *static_cast<array_iterator *>(static_cast<ref<array_iterator> *>(obj)->value());
+            if (ai.next >= ai.array->values.size())
+                return std::nullopt;
+            return ai.array->values[ai.next++];
+        }
+
         bool can_invoke(const std::string& method)
         {
             detail::call_def cd;
@@ -222,6 +624,7 @@ namespace simpl
 
         void push_stack(const value_t &v)
         {
+            counters_.pushes.add();
             stack_.push(v);
         }
 
@@ -229,6 +632,7 @@ namespace simpl
         {
             if (stack_.empty())
                 throw std::runtime_error("stack is empty");
+            counters_.pops.add();
 
             const auto top = stack_.top();
             stack_.pop();
@@ -257,14 +661,18 @@ namespace simpl
 
         void activate_function(const std::string &fn, size_t retval_offset)
         {
+            checkpoint();
             enter_scope();
             callstack_.push(activation_record{ fn, &stack_.offset(retval_offset) });
+            counters_.calls.add();
+            sample();
         }
 
         void return_()
         {
             if (callstack_.size() == 1)
                 throw std::runtime_error("bad return statement");
+            sample();
             auto &ar = callstack_.top();
             *ar.retval = stack_.top();
             stack_.pop();
@@ -278,17 +686,17 @@ namespace simpl
             constexpr auto sig = detail::get_signature<CallableT>();
             const auto id = detail::format("{0}({1})", name, sig.arguments_string(types_));
             const auto args = types_.translate_types(sig.arguments());
-            reg_fn(id, name, args, [this, fn]()
+            reg_fn(id, name, args, [fn](vm &self)
             {
-                auto args = load_args(*this, deducer<typename detail::signature<CallableT>::types>{});
+                auto args = self.load_args(self, deducer<typename detail::signature<CallableT>::bindings>{});
                 if constexpr(std::is_same_v<typename detail::signature<CallableT>::result_type, void>)
                 {
                     std::apply(fn, args);
-                    push_stack(empty_t{});
+                    self.push_stack(empty_t{});
                 }
                 else 
                 {
-                    push_stack(std::apply(fn, args));
+                    self.push_stack(std::apply(fn, args));
                 }
             });
         }
@@ -359,9 +767,31 @@ namespace simpl
             return types_.get_type(simpl_name);                 
         }
 
+        const detail::type_def* lookup_type(size_t id) const
+        {
+            return types_.get_type(id);
+        }
+
         void create_local_var(const std::string &name, size_t offset = 0)
         {
             locals_.top().track(name, &stack_.offset(offset));
+            if (locals_.size() == 1)
+                bind_global(name, &stack_.offset(offset));
+        }
+
+        // A stable id for a global variable, compiled code loads globals
+        // through these instead of searching each scope.
+        size_t global_slot(const std::string &name)
+        {
+            auto found = global_ids_.find(name);
+            if (found != global_ids_.end())
+                return found->second;
+
+            auto &global = locals_.offset(locals_.size() - 1);
+            globals_.push_back(global.has_value(name) ? &global.get_value(name) : nullptr);
+            global_names_.push_back(name);
+            global_ids_[name] = globals_.size() - 1;
+            return globals_.size() - 1;
         }
 
         void track_stack_var(const std::string& name, size_t offset = 0)
@@ -437,10 +867,10 @@ namespace simpl
             if (std::holds_alternative<size_t>(at))
             {
                 // check that the variable is an array
-                if (!std::holds_alternative<arrayref_t>(val))
+                if (!holds<arrayref_t>(val))
                     throw std::runtime_error("not an array");
 
-                auto& array = std::get<arrayref_t>(val);
+                auto& array = simpl::get<arrayref_t>(val);
                 return array->values.at(std::get<size_t>(at));
             }
 
@@ -449,23 +879,64 @@ namespace simpl
             // if the item is in scope we'll use that first.
             if (in_scope(name))
             {
-                if (!std::holds_alternative<arrayref_t>(val))
+                if (!holds<arrayref_t>(val))
                     throw std::runtime_error("not an array");
 
                 int idx = (int)cast<double>(load_var(name));
-                auto& array = std::get<arrayref_t>(val);
+                auto& array = simpl::get<arrayref_t>(val);
                 return array->values.at(idx);
             }
 
             // otherwise, we visit 			
             member_visitor mv(name);
-            std::visit(mv, val);
+            simpl::visit(mv, val);
 
             if (mv.value == nullptr)
                 throw std::runtime_error("bad access");
             return *mv.value;
         }
 
+        // value_at for a site that caches where a member was found, it only
+        // looks the name up when the object's shape or the blob's key differs.
+        value_t &value_at(value_t &val, const indexor &at, detail::member_cache &cache)
+        {
+            // a variable of the same name indexes instead, whether or not the
+            // site is warm, so hits check the scopes the same as misses.
+            if (std::holds_alternative<std::string>(at) && in_scope(std::get<std::string>(at)))
+                return value_at(val, at);
+
+            if (holds<blobref_t>(val) && std::holds_alternative<std::string>(at))
+            {
+                // entries are never removed, so blobs built alike hit.
+                auto &values = simpl::get<blobref_t>(val)->values;
+                if (cache.key == nullptr || cache.slot >= values.size() || values.entry(cache.slot).first.name != cache.key)
+                {
+                    const auto i = values.index_of(std::get<std::string>(at));
+                    if (i == values.npos)
+                        return value_at(val, at);
+                    cache = detail::member_cache{ nullptr, values.entry(i).first.name, i };
+                }
+                return values.entry(cache.slot).second;
+            }
+            if (holds<objectref_t>(val) && std::holds_alternative<std::string>(at))
+            {
+                const auto &obj = simpl::get<objectref_t>(val);
+                const auto layout = obj->layout();
+                if (layout != nullptr)
+                {
+                    if (layout != cache.layout)
+                    {
+                        const auto slot = layout->slot(std::get<std::string>(at));
+                        if (slot == detail::shape::npos)
+                            return value_at(val, at);
+                        cache = detail::member_cache{ layout, nullptr, slot };
+                    }
+                    return static_cast<simpl_object_t *>(obj.get())->slots[cache.slot];
+                }
+            }
+            return value_at(val, at);
+        }
+
         bool in_scope(const std::string &name)
         {
             size_t offset = 0;
@@ -511,6 +982,32 @@ namespace simpl
             return locals_;
         }
 
+        // see vm_stats, the counts are 0 unless built with SIMPL_STATS.
+        vm_stats stats() const
+        {
+            vm_stats s;
+            s.calls = counters_.calls.value();
+            s.exact_lookups = functions_.exact_lookups();
+            s.candidate_lookups = functions_.candidate_lookups();
+            s.is_a_checks = types_.is_a_checks();
+            s.blobs = counters_.blobs.value();
+            s.arrays = counters_.arrays.value();
+            s.objects = counters_.objects.value();
+            s.pushes = counters_.pushes.value();
+            s.pops = counters_.pops.value();
+            s.imports = counters_.imports.value();
+            s.import_time = std::chrono::nanoseconds(counters_.import_ns.value());
+            s.stack_high_water = stack_.high_water();
+            s.scope_high_water = locals_.high_water();
+            return s;
+        }
+
+        // for the execution context to count what it does on the vm's behalf.
+        detail::vm_counters &counters()
+        {
+            return counters_;
+        }
+
     public:
 
         void register_library(std::unique_ptr<library> &&lib)
@@ -537,16 +1034,468 @@ namespace simpl
                 id,
                 name,
                 args,
-                [this,fn = std::move(fn)]()
+                [fn = std::move(fn)](vm &self)
                 {
-                    fn();
-                    return_();
-                }
+                    fn(self);
+                    self.return_();
+                },
+                nullptr,
+                {}
             });
         }
 
     private:
 
+        void bind_global(const std::string &name, value_t *v)
+        {
+            auto found = global_ids_.find(name);
+            if (found != global_ids_.end())
+                globals_[found->second] = v;
+        }
+
+        // Globals are only used as such from the top level, anywhere else a
+        // caller's local may hide them.
+        value_t &global(size_t slot)
+        {
+            auto v = globals_[slot];
+            if (v == nullptr || callstack_.size() != 1)
+                return load_var(global_names_[slot]);
+            return *v;
+        }
+
+        value_t &resolve(const var_ref &ref, size_t base, detail::member_cache *members)
+        {
+            value_t *val = nullptr;
+            switch (ref.kind)
+            {
+            case ref_kind::local:
+                val = &stack_.at(base + ref.slot);
+                break;
+            case ref_kind::global:
+                val = &global(ref.slot);
+                break;
+            default:
+                val = &load_var(ref.id->name);
+                break;
+            }
+
+            const auto &path = ref.id->path;
+            for (size_t i = 0; i < path.size(); ++i)
+            {
+                if (ref.index_slots[i] < 0)
+                {
+                    val = &value_at(*val, path[i], members[ref.members + i]);
+                    continue;
+                }
+                if (!holds<arrayref_t>(*val))
+                    throw std::runtime_error("not an array");
+                int idx = (int)cast<double>(stack_.at(base + ref.index_slots[i]));
+                val = &simpl::get<arrayref_t>(*val)->values.at(idx);
+            }
+            return *val;
+        }
+
+        void track_arguments(const chunk &body)
+        {
+            const auto &ids = body.arguments;
+            for (size_t i = 0; i < ids.size(); ++i)
+                track_stack_var(ids[i], ids.size() - (i + 1));
+        }
+
+        std::vector<size_t> make_arg_ids(size_t arity)
+        {
+            std::vector<size_t> args;
+            for (size_t i = arity; i > 0; --i)
+            {
+                args.push_back(detail::get_type_id(stack_.offset(i - 1)));
+            }
+            return args;
+        }
+
+        // works on the operands where they sit, the result replaces them.
+        template <typename OpT>
+        void binary()
+        {
+            auto result = simpl::apply<OpT>(stack_.offset(1), stack_.offset(0));
+            stack_.pop();
+            stack_.top() = std::move(result);
+        }
+
+        void step(value_t &target, double by, bool pre)
+        {
+            auto value = simpl::get<number>(target);
+            if (!pre)
+                push_stack(value_t{ value });
+            value += by;
+            target = value_t{ value };
+            if (pre)
+                push_stack(value_t{ value });
+        }
+
+        void run(const chunk &entry)
+        {
+            run(entry, stack_.size() - entry.arguments.size(), 0);
+        }
+
+        // The dispatch loop. Calls between compiled functions stay inside
+        // the loop as frames, native functions are called directly. It
+        // starts entry at pc with its frame at base, and returns where to
+        // carry on if entry yields, 0 once it's done.
+        size_t run(const chunk &entry, size_t base, size_t pc)
+        {
+            const auto stack_size = stack_.size();
+            const auto scopes = locals_.size();
+            const auto calls = callstack_.size();
+
+            std::vector<frame> frames;
+            std::vector<size_t> marks;
+            chunk_caches *caches = &caches_for(entry);
+            frames.push_back(frame{ &entry, 0, 0, base, caches });
+
+            const chunk *code = &entry;
+            const instruction *ip = code->code.data() + pc;
+            try
+            {
+                while (1)
+                {
+                    const auto &ins = *ip++;
+                    switch (ins.op)
+                    {
+                    case opcode::push:
+                        stack_.push(code->constants[ins.arg]);
+                        break;
+                    case opcode::push_empty:
+                        stack_.push(value_t{});
+                        break;
+                    case opcode::pop:
+                        stack_.pop();
+                        break;
+                    case opcode::mark:
+                        marks.push_back(stack_.size());
+                        break;
+                    case opcode::unwind:
+                        stack_.pop(stack_.size() - marks.back());
+                        marks.pop_back();
+                        break;
+                    case opcode::single:
+                        if (stack_.size() - marks.back() != 1)
+                            throw std::runtime_error("invalid expression.");
+                        marks.pop_back();
+                        break;
+                    case opcode::load:
+                        stack_.push(resolve(code->refs[ins.arg], base, caches->members.data()));
+                        break;
+                    case opcode::store:
+                        resolve(code->refs[ins.arg], base, caches->members.data()) = stack_.top();
+                        break;
+                    case opcode::load_local:
+                        stack_.push(stack_.at(base + ins.arg));
+                        break;
+                    case opcode::store_local:
+                        stack_.at(base + ins.arg) = stack_.top();
+                        break;
+                    case opcode::load_global:
+                        stack_.push(global(ins.arg));
+                        break;
+                    case opcode::store_global:
+                        global(ins.arg) = stack_.top();
+                        break;
+                    case opcode::declare:
+                        create_local_var(code->names[ins.arg]);
+                        break;
+                    case opcode::add:
+                        binary<add_op>();
+                        break;
+                    case opcode::sub:
+                        binary<sub_op>();
+                        break;
+                    case opcode::mult:
+                        binary<mult_op>();
+                        break;
+                    case opcode::div:
+                        binary<div_op>();
+                        break;
+                    case opcode::eqeq:
+                        binary<eqeq_op>();
+                        break;
+                    case opcode::neq:
+                        binary<neq_op>();
+                        break;
+                    case opcode::lt:
+                        binary<lt_op>();
+                        break;
+                    case opcode::lte:
+                        binary<lte_op>();
+                        break;
+                    case opcode::gt:
+                        binary<gt_op>();
+                        break;
+                    case opcode::gte:
+                        binary<gte_op>();
+                        break;
+                    case opcode::jump:
+                        if (code->code.data() + ins.arg < ip)
+                        {
+                            // a loop's back edge.
+                            sample();
+                            checkpoint();
+                        }
+                        ip = code->code.data() + ins.arg;
+                        break;
+                    case opcode::jump_false:
+                    {
+                        const bool cond = cast<bool>(stack_.top());
+                        stack_.pop();
+                        if (!cond)
+                            ip = code->code.data() + ins.arg;
+                        break;
+                    }
+                    case opcode::and_jump:
+                        if (!cast<bool>(stack_.top()))
+                            ip = code->code.data() + ins.arg;
+                        else
+                            stack_.pop();
+                        break;
+                    case opcode::or_jump:
+                        if (cast<bool>(stack_.top()))
+                            ip = code->code.data() + ins.arg;
+                        else
+                            stack_.pop();
+                        break;
+                    case opcode::call:
+                    case opcode::tail_call:
+                    {
+                        const auto arity = stack_.size() - marks.back();
+                        marks.pop_back();
+                        const auto &site = code->calls[ins.arg];
+                        auto &cache = caches->calls[ins.arg];
+                        auto arg = [&](size_t i) -> const value_t & { return stack_.offset(arity - (i + 1)); };
+                        auto fn = cache.find(functions_, arity, arg);
+                        if (fn == nullptr)
+                        {
+                            fn = functions_.lookup(site.expr->identifier().name, make_arg_ids(arity));
+                            cache.add(functions_, arity, arg, fn);
+                        }
+                        if (ins.op == opcode::tail_call && fn->body && frames.size() > 1 && tail_call_hides(*fn->body, frames.back().code, ip->arg))
+                        {
+                            // the arguments take the place of the returning
+                            // frame's, its locals and nested scopes go.
+                            auto &f = frames.back();
+                            const auto from = stack_.size() - arity;
+                            for (size_t i = 0; i < arity; ++i)
+                                stack_.at(f.base + i) = std::move(stack_.at(from + i));
+                            stack_.pop(stack_.size() - (f.base + arity));
+                            for (uint32_t i = 0; i < ip->arg; ++i)
+                                locals_.pop();
+                            if (fn->body.get() != f.code || locals_.top().locals() != 0)
+                            {
+                                locals_.top().clear();
+                                track_arguments(*fn->body);
+                            }
+                            if (fn->body.get() != f.code)
+                            {
+                                callstack_.top().function = fn->name;
+                                caches = &caches_for(*fn->body);
+                                code = fn->body.get();
+                                f = frame{ code, 0, arity, f.base, caches };
+                            }
+                            ip = code->code.data();
+                            counters_.calls.add();
+                            sample();
+                            checkpoint();
+                        }
+                        else if (fn->body)
+                        {
+                            frames.back().pc = ip - code->code.data();
+                            activate_function(fn->name, arity);
+                            track_arguments(*fn->body);
+                            base = stack_.size() - arity;
+                            caches = &caches_for(*fn->body);
+                            frames.push_back(frame{ fn->body.get(), 0, arity, base, caches });
+                            code = fn->body.get();
+                            ip = code->code.data();
+                        }
+                        else
+                        {
+                            call(fn);
+                            stack_.pop(arity);
+                        }
+                        break;
+                    }
+                    case opcode::expand:
+                    {
+                        auto top = pop_stack();
+                        if (!holds<arrayref_t>(top))
+                            throw std::runtime_error("invalid expansion.");
+                        for (const auto &v : simpl::get<arrayref_t>(top)->values)
+                            stack_.push(v);
+                        break;
+                    }
+                    case opcode::pre_incr:
+                        step(resolve(code->refs[ins.arg], base, caches->members.data()), 1, true);
+                        break;
+                    case opcode::post_incr:
+                        step(resolve(code->refs[ins.arg], base, caches->members.data()), 1, false);
+                        break;
+                    case opcode::pre_decr:
+                        step(resolve(code->refs[ins.arg], base, caches->members.data()), -1, true);
+                        break;
+                    case opcode::post_decr:
+                        step(resolve(code->refs[ins.arg], base, caches->members.data()), -1, false);
+                        break;
+                    case opcode::new_blob:
+                        counters_.blobs.add();
+                        stack_.push(new_blob());
+                        break;
+                    case opcode::blob_init:
+                    {
+                        auto v = pop_stack();
+                        simpl::get<blobref_t>(stack_.top())->values[code->keys[ins.arg]] = std::move(v);
+                        break;
+                    }
+                    case opcode::new_array:
+                        counters_.arrays.add();
+                        stack_.push(new_array());
+                        break;
+                    case opcode::array_init:
+                    {
+                        const auto count = stack_.size() - marks.back();
+                        marks.pop_back();
+                        auto &values = simpl::get<arrayref_t>(stack_.offset(count))->values;
+                        for (size_t i = count; i > 0; --i)
+                            values.push_back(stack_.offset(i - 1));
+                        stack_.pop(count);
+                        break;
+                    }
+                    case opcode::enter_scope:
+                        enter_scope();
+                        break;
+                    case opcode::exit_scope:
+                        exit_scope();
+                        break;
+                    case opcode::ret:
+                    {
+                        return_();
+                        for (uint32_t i = 0; i < ins.arg; ++i)
+                            exit_scope();
+                        const auto arity = frames.back().arity;
+                        frames.pop_back();
+                        if (frames.empty())
+                            return 0;
+                        stack_.pop(arity);
+                        code = frames.back().code;
+                        base = frames.back().base;
+                        caches = frames.back().caches;
+                        ip = code->code.data() + frames.back().pc;
+                        break;
+                    }
+                    case opcode::yield:
+                        if (frames.size() != 1)
+                            throw std::runtime_error("yield outside a generator");
+                        return ip - code->code.data();
+                    case opcode::iter:
+                        stack_.top() = make_iterator(stack_.top());
+                        break;
+                    case opcode::iter_next:
+                    {
+                        auto next = iterate(value_t{ stack_.top() });
+                        if (next)
+                            stack_.push(std::move(*next));
+                        else
+                            ip = code->code.data() + ins.arg;
+                        break;
+                    }
+                    case opcode::def:
+                        define(code->functions[ins.arg]);
+                        break;
+                    case opcode::eval:
+                        code->statements[ins.arg]->evaluate(evaluator());
+                        break;
+                    case opcode::eval_expr:
+                        code->expressions[ins.arg]->evaluate(evaluator());
+                        break;
+                    case opcode::end:
+                        return 0;
+                    }
+                }
+            }
+            catch (...)
+            {
+                unwind_to(stack_size, scopes, calls);
+                throw;
+            }
+        }
+
+        // put the machine back the way it was found.
+        void unwind_to(size_t stack_size, size_t scopes, size_t calls)
+        {
+            while (callstack_.size() > calls)
+                callstack_.pop();
+            while (locals_.size() > scopes)
+                locals_.pop();
+            if (stack_.size() > stack_size)
+                stack_.pop(stack_.size() - stack_size);
+        }
+
+        // A call in tail position may replace the frame returning it only if
+        // the callee couldn't have seen anything that goes with it; callees see
+        // their caller's variables unless their arguments hide them.
+        bool tail_call_hides(const chunk &callee, const chunk *current, uint32_t nested)
+        {
+            for (uint32_t i = 0; i <= nested; ++i)
+            {
+                const auto &scope = locals_.offset(i);
+                if (i == nested && &callee == current && scope.locals() == 0)
+                    break; // only the arguments, the same ones.
+                if (!scope.hidden_by(callee.arguments))
+                    return false;
+            }
+            return true;
+        }
+
+        // the deadline is only looked at once a window.
+        static constexpr uint64_t Clock_Window = 256;
+
+        uint64_t next_window() const
+        {
+            if (budget_.operations != 0)
+                return std::min(Clock_Window, budget_.operations - spent_);
+            if (budget_.deadline != std::chrono::steady_clock::time_point::max())
+                return Clock_Window;
+            return std::numeric_limits<uint64_t>::max();
+        }
+
+        void spend()
+        {
+            spent_ += window_;
+            if (budget_.operations != 0 && spent_ >= budget_.operations)
+            {
+                countdown_ = 1;
+                throw budget_exceeded("operation budget exhausted");
+            }
+            if (std::chrono::steady_clock::now() >= budget_.deadline)
+            {
+                countdown_ = 1;
+                throw budget_exceeded("deadline passed");
+            }
+            window_ = next_window();
+            countdown_ = window_;
+        }
+
+        void sample()
+        {
+            if (profiler_ != nullptr && profiler_->due())
+                profiler_->sample(callstack_);
+        }
+
+        chunk_caches &caches_for(const chunk &c)
+        {
+            auto found = caches_.find(&c);
+            if (found == caches_.end())
+                found = caches_.emplace(&c, chunk_caches(c)).first;
+            return found->second;
+        }
+
         detail::call_def make_dynamic_call(const std::string& method, std::initializer_list<value_t> args)
         {
             detail::call_def cd;
@@ -558,12 +1507,52 @@ namespace simpl
             return cd;
         }
 
+        // A host function, or a function the tree walker runs, is called on the
+        // thread's stack. The outermost one marks where that stack was, the
+        // ones nested in it throw once they're native_stack bytes below it.
+        class native_frame
+        {
+        public:
+            explicit native_frame(vm &v)
+                :vm_(v), outermost_(v.native_base_ == 0)
+            {
+                const auto here = reinterpret_cast<uintptr_t>(this);
+                if (outermost_)
+                    vm_.native_base_ = here;
+                else if ((vm_.native_base_ > here ? vm_.native_base_ - here : here - vm_.native_base_) > vm_.native_limit_)
+                    throw std::runtime_error("stack overflow");
+            }
+
+            ~native_frame()
+            {
+                if (outermost_)
+                    vm_.native_base_ = 0;
+            }
+
+        private:
+            vm &vm_;
+            const bool outermost_;
+        };
+
         detail::type_table types_;
         detail::dispatch_table functions_;
         stack_t stack_;
         locals_t locals_;
         callstack_t callstack_;
-        std::map<std::string, std::unique_ptr<simpl::library>> libraries_;
+        size_t native_limit_;
+        uintptr_t native_base_ = 0;
+        std::map<std::string, std::shared_ptr<simpl::library>> libraries_; // shared by copies.
+        tree_evaluator *fallback_ = nullptr;
+        std::vector<value_t *> globals_;
+        std::vector<std::string> global_names_;
+        std::map<std::string, size_t> global_ids_;
+        std::unordered_map<const chunk *, chunk_caches> caches_; // not copied, each vm learns its own.
+        simpl::profiler *profiler_ = nullptr;
+        detail::vm_counters counters_;
+        work_budget budget_;
+        uint64_t spent_ = 0;
+        uint64_t window_ = std::numeric_limits<uint64_t>::max();
+        uint64_t countdown_ = std::numeric_limits<uint64_t>::max();
 
     };
 }
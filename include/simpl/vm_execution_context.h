@@ -1,9 +1,13 @@
 #ifndef __simpl_vm_execution_context_h__
 #define __simpl_vm_execution_context_h__
 
+#include <simpl/compiler.h>
 #include <simpl/expression.h>
+#include <simpl/module_cache.h>
 #include <simpl/operations.h>
+#include <simpl/optimizer.h>
 #include <simpl/parser.h>
+#include <simpl/source.h>
 #include <simpl/statement.h>
 #include <simpl/vm.h>
 
@@ -38,50 +42,15 @@ namespace simpl
 		private:
 			vm &vm_;
 		};
-
-		inline std::string to_simpl_type_string(vm &vm, const simpl::argument &a)
-		{
-			const auto &simpl_type = a.type;
-			auto type_str = simpl_type.has_value() ? detail::to_builtin_type_string(simpl_type.value()) : "any";
-			if (!type_str.has_value() && vm.has_type(simpl_type.value()))
-				type_str = vm.lookup_type(simpl_type.value())->name;
-			if (!type_str.has_value())
-				throw std::runtime_error(detail::format("unknown type '{0}'", (simpl_type.has_value() ? simpl_type.value() : "<t>")));
-			return type_str.value();
-		}
-
-		inline std::string format_name(vm& vm, const std::string &name, const std::vector<argument> &arguments)
-		{
-			std::stringstream ss;
-			ss << name << "(";
-			for (size_t i = 0; i < arguments.size(); ++i)
-			{
-				const auto type_str = to_simpl_type_string(vm, arguments[i]);
-				ss << type_str;
-				if (i != arguments.size() - 1)
-					ss << ",";
-			}
-			ss << ")";
-			return ss.str();
-		}
-
-		inline std::vector<std::string> to_arg_types(vm &vm, const std::vector<simpl::argument> &args)
-		{
-			std::vector<std::string> ret;
-			for (const simpl::argument &a : args)
-			{
-				ret.push_back(to_simpl_type_string(vm,a));
-			}
-			return ret;
-		}
 	}
 
-	class vm_execution_context : public statement_visitor, public expression_visitor
+	class vm_execution_context : public tree_evaluator
 	{
 	public:
 		vm_execution_context(simpl::vm &vm)
-			:vm_(vm)
+			:vm_(vm), bytecode_(true), optimize_(true), cache_(module_cache::from_environment())
 		{
+			vm_.fallback(this);
 			vm_.register_type<simpl::value>("any");
 			vm_.register_type<simpl::empty>("empty");
 			vm_.register_type<simpl::string>("string");
@@ -89,13 +58,43 @@ namespace simpl
 			vm_.register_type<simpl::number>("number");
 			vm_.register_type<simpl::blob>("blob");
 			vm_.register_type<simpl::array>("array");
+			vm_.register_type<simpl::generator>("generator");
 
 			vm_.reg_fn("is_empty", [](const value_t &v)
 			{
-				return std::holds_alternative<empty_t>(v);
+				return holds<empty_t>(v);
+			});
+
+			// the generator's next value, empty once it's done.
+			vm_.reg_fn(detail::fn_def{ "next(generator)", "next", { "generator" }, [](simpl::vm &self)
+			{
+				auto &g = detail::get_value<generator>(self.stack_offset(0));
+				auto next = self.resume(g);
+				self.push_stack(next ? std::move(*next) : value_t{});
+				self.return_();
+			}, nullptr, {} });
+			vm_.reg_fn("done", [](generator &g)
+			{
+				return g.done();
 			});
 		}
 
+		// the context of rhs for vm, a copy of rhs's vm; what's been
+		// imported and the settings carry over.
+		vm_execution_context(simpl::vm &vm, const vm_execution_context &rhs)
+			:vm_(vm), imported_(rhs.imported_), bytecode_(rhs.bytecode_), optimize_(rhs.optimize_), cache_(rhs.cache_)
+		{
+			vm_.fallback(this);
+		}
+
+		vm_execution_context(const vm_execution_context &) = delete;
+		vm_execution_context &operator=(const vm_execution_context &) = delete;
+
+		std::unique_ptr<tree_evaluator> copy_for(simpl::vm &copy) const override
+		{
+			return std::make_unique<vm_execution_context>(copy, *this);
+		}
+
 	public:
 		virtual void visit(expr_statement &cs)
 		{
@@ -159,6 +158,14 @@ namespace simpl
 
 		virtual void visit(def_statement &ds)
 		{
+			if (ds.generator())
+			{
+				// generators only run compiled, they're resumed where they yielded.
+				auto args = ds.arguments();
+				auto code = compile(vm_, std::make_unique<def_statement>(ds.name(), std::move(args), ds.release_statement(), true));
+				vm_.execute(*code);
+				return;
+			}
 			auto id = detail::format_name(vm_, ds.name(), ds.arguments());
 			auto arity = ds.arguments().size();
 			auto stmt = ds.release_statement();
@@ -167,13 +174,15 @@ namespace simpl
 				id,
 				ds.name(),
 				detail::to_arg_types(vm_, ds.arguments()),
-				[this, arity, ids = ds.arguments(), stmt = std::shared_ptr<statement>(stmt.release())]()
+				[arity, ids = ds.arguments(), stmt = std::shared_ptr<statement>(stmt.release())](simpl::vm &vm)
 				{
 					int offset = arity - 1;
 					for (; offset >= 0; --offset)
-						vm_.track_stack_var(ids[ids.size() - (offset + 1)].name, offset);
-					stmt->evaluate(*this);
-				}
+						vm.track_stack_var(ids[ids.size() - (offset + 1)].name, offset);
+					stmt->evaluate(vm.evaluator());
+				},
+				nullptr,
+				{}
 			};
 			vm_.reg_fn(std::move(fn));
 		}
@@ -214,6 +223,7 @@ namespace simpl
 				detail::scope s{ vm_ };
 				ws.block()->evaluate(*this);
 			}
+			vm_.checkpoint();
 			goto run_cond;
 		}
 
@@ -231,10 +241,36 @@ namespace simpl
 				detail::scope s{ vm_ };
 				fs.block()->evaluate(*this);
 			}
+			const auto sz = vm_.stack_size();
 			fs.incr()->evaluate(*this);
+			vm_.decrement_stack(vm_.stack_size() - sz); // the increment's value isn't used.
+			vm_.checkpoint();
 			goto run_for_cond;
 		}
 
+		virtual void visit(for_in_statement &fs)
+		{
+			detail::scope loop{ vm_ };
+			fs.source()->evaluate(*this);
+			vm_.push_stack(vm_.make_iterator(vm_.pop_stack()));
+			vm_.create_local_var("(iterator)");
+			const auto it = vm_.stack_offset(0);
+			while (auto next = vm_.iterate(it))
+			{
+				detail::scope s{ vm_ };
+				vm_.push_stack(std::move(*next));
+				vm_.create_local_var(fs.name());
+				if (fs.block())
+					fs.block()->evaluate(*this);
+				vm_.checkpoint();
+			}
+		}
+
+		virtual void visit(yield_statement &)
+		{
+			throw std::runtime_error("yield outside a generator");
+		}
+
 		virtual void visit(import_statement& is) override
 		{
 			auto done = std::find(imported_.begin(), imported_.end(), is.libname());
@@ -245,6 +281,7 @@ namespace simpl
 			if (ctx != importing_.end())
 				throw std::runtime_error("cyclical import detected.");
 			importing_.emplace_back(is.libname());
+			detail::stopwatch took;
 
 			std::filesystem::path p(is.libname());
 			auto ext = p.extension().string();
@@ -273,6 +310,9 @@ namespace simpl
 
 			imported_.emplace_back(is.libname());
 			importing_.pop_back();
+			vm_.counters().imports.add();
+			if (importing_.empty())
+				vm_.counters().import_ns.add(took.elapsed_ns()); // nested imports are inside it.
 		}
 
 		virtual void visit(expression &ex)
@@ -297,13 +337,14 @@ namespace simpl
 		virtual void visit(new_blob_expression &ns)
 		{
 			auto blob = new_blob();
+			vm_.counters().blobs.add();
 			vm_.push_stack(blob);
-			for (const auto &init : ns.initializers())
+			for (size_t i = 0; i < ns.initializers().size(); ++i)
 			{
-				if (init.expr)
+				if (ns.initializers()[i].expr)
 				{
-					init.expr->evaluate(*this);
-					blob->values[init.identifier] = vm_.pop_stack();
+					ns.initializers()[i].expr->evaluate(*this);
+					blob->values[ns.keys()[i]] = vm_.pop_stack();
 				}
 			}
 		}
@@ -311,6 +352,7 @@ namespace simpl
 		virtual void visit(new_array_expression &nas)
 		{
 			auto array = new_array();
+			vm_.counters().arrays.add();
 			vm_.push_stack(array);
 			for (const auto &expr : nas.expressions())
 			{
@@ -322,46 +364,20 @@ namespace simpl
 		virtual void visit(new_object_expression &nos)
 		{
 			// lookup the type
-			auto type = vm_.lookup_type(nos.type());
+			auto type = vm_.lookup_type(nos.type_id());
 
 			if (type == nullptr)
 				throw std::runtime_error("unknown type");
 
-			auto object = new_simpl_object(nos.type());
+			auto object = new_simpl_object(type->name, type->id, type->layout);
+			vm_.counters().objects.add();
 			vm_.push_stack(object);
 
-			// Initialize the members based on hierarchy
-			// TODO: Optimize this based on each levels initializers.
-			// TODO: Also, really need to look at identifiers and whether 
-			// they're defined or not. But, this could be done in the 
-			// parser, if the parser knows about the types.
-			std::stack<const detail::type_def *> types;
-			while (type != nullptr)
+			// run the type initializers, the slots start empty.
+			for (const auto &[slot, init] : type->initializers)
 			{
-				types.push(type);
-				type = type->inherits;
-			}
-			// run the type initializers
-			while (types.size() > 0)
-			{
-				type = types.top();
-				for (const auto &mi : type->members)
-				{
-					// Again -- this could be a parse time thing...
-					if (object->members.find(mi.name) != object->members.end() && mi.initializer == nullptr)
-						throw std::runtime_error(detail::format("redfinition of member '{0}' in type '{1}'", mi.name, nos.type()));
-
-					if (mi.initializer)
-					{
-						mi.initializer->evaluate(*this);
-						object->members[mi.name] = vm_.pop_stack();
-					}
-					else
-					{
-						object->members[mi.name] = value_t{};
-					}
-				}
-				types.pop();
+				init->evaluate(*this);
+				object->slots[slot] = vm_.pop_stack();
 			}
 
 			// run the expression initializers
@@ -370,7 +386,7 @@ namespace simpl
 				if (init.expr)
 				{
 					init.expr->evaluate(*this);
-					object->members[init.identifier] = vm_.pop_stack();
+					object->set_member(init.identifier, vm_.pop_stack());
 				}
 			}
 
@@ -478,18 +494,72 @@ namespace simpl
 
 		void evaluate(syntax_tree& ast)
 		{
+			if (optimize_)
+				optimize(ast);
 			for (auto& stmt : ast)
 			{
-				evaluate(std::move(stmt));
+				run(std::move(stmt));
 			}
 		}
 
 		void evaluate(statement_ptr statement)
 		{
-			statement->evaluate(*this);
+			if (optimize_)
+				optimize(statement);
+			run(std::move(statement));
+		}
+
+		// Compile statements to bytecode before running them (the default),
+		// or walk the syntax tree directly.
+		void use_bytecode(bool enabled)
+		{
+			bytecode_ = enabled;
+		}
+
+		bool use_bytecode() const
+		{
+			return bytecode_;
+		}
+
+		// Fold constants, propagate let constants and drop dead branches
+		// before running (the default).
+		void use_optimizer(bool enabled)
+		{
+			optimize_ = enabled;
+		}
+
+		bool use_optimizer() const
+		{
+			return optimize_;
+		}
+
+		// Keep parsed .sl imports in dir and load them from there while the
+		// text is unchanged. Defaults to SIMPL_CACHE; an empty path turns
+		// the cache off.
+		void use_module_cache(const std::filesystem::path &dir)
+		{
+			if (dir.empty())
+				cache_.reset();
+			else
+				cache_.emplace(dir);
+		}
+
+		std::filesystem::path module_cache_directory() const
+		{
+			return cache_ ? cache_->directory() : std::filesystem::path{};
 		}
 
 	private:
+		void run(statement_ptr statement)
+		{
+			if (!statement)
+				return;
+			if (!bytecode_)
+				return vm_.unwinding([&]() { statement->evaluate(*this); });
+
+			auto code = compile(vm_, std::move(statement));
+			vm_.execute(*code);
+		}
 
 		// Returns the directories to search, in the 5-step order:
 		//   1. Current working directory
@@ -580,15 +650,19 @@ namespace simpl
 				auto full = dir / filename;
 				if (!std::filesystem::exists(full))
 					continue;
-				std::ifstream t(full);
-				if (!t.good())
+				source_buffer source;
+				try
+				{
+					source = source_buffer::map(full);
+				}
+				catch (const std::runtime_error &)
+				{
 					continue;
-				std::stringstream buffer;
-				buffer << t.rdbuf();
+				}
 				script_dirs_.push_back(std::filesystem::absolute(full).parent_path());
 				try
 				{
-					auto ast = simpl::parse(buffer.str());
+					auto ast = cache_ ? cache_->load(source) : simpl::parse(source);
 					evaluate(ast);
 				}
 				catch (const token_error& te)
@@ -663,10 +737,9 @@ namespace simpl
 			left->evaluate(*this);
 			right->evaluate(*this);
 
-			auto rvalue = vm.pop_stack();
-			auto lvalue = vm.pop_stack();
-
-			vm.push_stack(apply<OpT>(lvalue, rvalue));
+			auto result = simpl::apply<OpT>(vm.stack_offset(1), vm.stack_offset(0));
+			vm.decrement_stack(2);
+			vm.push_stack(std::move(result));
 		}
 		
 		void do_and(const nary_expression &exp, vm &vm)
@@ -716,9 +789,9 @@ namespace simpl
 			exp.expressions()[0]->evaluate(*this);
 			// top of the stack should be an array, now we'll expand it.
 			auto top = vm_.pop_stack();
-			if (!std::holds_alternative<arrayref_t>(top))
+			if (!holds<arrayref_t>(top))
 				throw std::runtime_error("invalid expansion.");
-			arrayref_t arr = std::get<arrayref_t>(top);
+			arrayref_t arr = simpl::get<arrayref_t>(top);
 			for (const auto &v : arr->values)
 			{
 				vm.push_stack(v);
@@ -732,7 +805,7 @@ namespace simpl
 			{
 				// pre
 				const auto& id = std::get<identifier>(exp.expressions()[0]->value());
-				auto& value = std::get<number>(vm_.load_var(id));
+				auto value = simpl::get<number>(vm_.load_var(id));
 				++value;
 				vm_.set_val(id, value_t{ value });
 				vm_.push_stack(value_t{ value });
@@ -741,7 +814,7 @@ namespace simpl
 			{
 				// post-increment; i=i++;
 				const auto& id = std::get<identifier>(exp.expressions()[1]->value());
-				auto value = std::get<number>(vm_.load_var(id));
+				auto value = simpl::get<number>(vm_.load_var(id));
 				vm_.push_stack(value_t{ value });
 				++value;
 				vm_.set_val(id, value_t{ value });
@@ -754,7 +827,7 @@ namespace simpl
 			{
 				// pre
 				const auto& id = std::get<identifier>(exp.expressions()[0]->value());
-				auto& value = std::get<number>(vm_.load_var(id));
+				auto value = simpl::get<number>(vm_.load_var(id));
 				--value;
 				vm_.set_val(id, value_t{ value });
 				vm_.push_stack(value_t{ value });
@@ -763,7 +836,7 @@ namespace simpl
 			{
 				// post-increment; i=i++;
 				const auto& id = std::get<identifier>(exp.expressions()[1]->value());
-				auto value = std::get<number>(vm_.load_var(id));
+				auto value = simpl::get<number>(vm_.load_var(id));
 				vm_.push_stack(value_t{ value });
 				--value;
 				vm_.set_val(id, value_t{ value });
@@ -803,6 +876,9 @@ namespace simpl
 		std::vector<std::string> importing_;
 		std::vector<std::string> imported_;
 		std::vector<std::filesystem::path> script_dirs_;
+		bool bytecode_;
+		bool optimize_;
+		std::optional<module_cache> cache_;
 	};
 }
 
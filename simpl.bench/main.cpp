@@ -0,0 +1,267 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#define SIMPL_DEFINES
+#include <simpl/simpl.h>
+
+namespace
+{
+	using clock_type = std::chrono::steady_clock;
+
+	struct options
+	{
+		size_t warmup = 3;
+		size_t reps = 10;
+		std::string format = "text";
+		std::string filter;
+		std::string out;
+		std::filesystem::path corpus = "corpus";
+		bool optimize = true;
+		bool bytecode = true;
+		bool parse_only = false;
+	};
+
+	struct benchmark
+	{
+		std::string name;
+		std::string source;
+		double ops;
+	};
+
+	struct result
+	{
+		std::string name;
+		double ops;
+		std::vector<double> samples; // milliseconds, sorted.
+
+		double median() const
+		{
+			const auto n = samples.size();
+			return n % 2 ? samples[n / 2] : (samples[n / 2 - 1] + samples[n / 2]) / 2;
+		}
+
+		// nearest rank.
+		double percentile(double p) const
+		{
+			auto rank = static_cast<size_t>(std::ceil(p * samples.size()));
+			return samples[std::clamp<size_t>(rank, 1, samples.size()) - 1];
+		}
+
+		double mean() const
+		{
+			double total = 0;
+			for (auto s : samples)
+				total += s;
+			return total / samples.size();
+		}
+
+		double ops_per_sec() const
+		{
+			const auto m = median();
+			return m > 0 ? ops / (m / 1000.0) : 0;
+		}
+	};
+
+	void print_help()
+	{
+		std::cout << "usage: simpl.bench [options] [corpus directory]\n"
+			<< "  --warmup N       untimed runs before measuring (default 3)\n"
+			<< "  --reps N         timed runs (default 10)\n"
+			<< "  --filter TEXT    only run benchmarks whose name contains TEXT\n"
+			<< "  --format F       text, json or csv (default text)\n"
+			<< "  --out FILE       write the results to FILE instead of stdout\n"
+			<< "  --no-optimize    skip the AST optimizer\n"
+			<< "  --tree           walk the syntax tree instead of compiling to bytecode\n"
+			<< "  --parse          only time parsing the scripts\n";
+	}
+
+	// the op count comes from a '# ops: N' line in the script, or is 1.
+	double read_ops(const std::string &source)
+	{
+		const std::string tag = "# ops:";
+		auto pos = source.find(tag);
+		if (pos == std::string::npos)
+			return 1;
+		return std::stod(source.substr(pos + tag.size()));
+	}
+
+	std::vector<benchmark> load_corpus(const options &opts)
+	{
+		std::vector<benchmark> corpus;
+		for (const auto &entry : std::filesystem::directory_iterator(opts.corpus))
+		{
+			const auto &path = entry.path();
+			if (path.extension() != ".sl")
+				continue;
+			const auto name = path.stem().string();
+			if (!opts.filter.empty() && name.find(opts.filter) == std::string::npos)
+				continue;
+
+			std::ifstream fs(path);
+			std::string source((std::istreambuf_iterator<char>(fs)), std::istreambuf_iterator<char>());
+			corpus.push_back(benchmark{ name, source, read_ops(source) });
+		}
+		std::sort(corpus.begin(), corpus.end(), [](const auto &l, const auto &r) { return l.name < r.name; });
+		return corpus;
+	}
+
+	// a fresh engine each run; only parsing and running the script is timed,
+	// or just parsing with --parse.
+	double run_once(const benchmark &b, const options &opts)
+	{
+		simpl::engine e;
+		e.context().use_optimizer(opts.optimize);
+		e.context().use_bytecode(opts.bytecode);
+
+		const auto start = clock_type::now();
+		auto ast = simpl::parse(b.source);
+		if (!opts.parse_only)
+			simpl::evaluate(ast, e);
+		return std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+	}
+
+	result measure(const benchmark &b, const options &opts)
+	{
+		for (size_t i = 0; i < opts.warmup; ++i)
+			run_once(b, opts);
+
+		result r{ b.name, b.ops, {} };
+		for (size_t i = 0; i < opts.reps; ++i)
+			r.samples.push_back(run_once(b, opts));
+		std::sort(r.samples.begin(), r.samples.end());
+		return r;
+	}
+
+	void write_text(std::ostream &os, const std::vector<result> &results)
+	{
+		os << std::left << std::setw(12) << "name"
+			<< std::right << std::setw(12) << "median ms"
+			<< std::setw(12) << "p95 ms"
+			<< std::setw(12) << "min ms"
+			<< std::setw(16) << "ops/sec" << "\n";
+		os << std::fixed;
+		for (const auto &r : results)
+		{
+			os << std::left << std::setw(12) << r.name << std::right << std::setprecision(3)
+				<< std::setw(12) << r.median()
+				<< std::setw(12) << r.percentile(0.95)
+				<< std::setw(12) << r.samples.front()
+				<< std::setprecision(0) << std::setw(16) << r.ops_per_sec() << "\n";
+		}
+	}
+
+	void write_json(std::ostream &os, const std::vector<result> &results, const options &opts)
+	{
+		os << std::setprecision(6) << std::fixed;
+		os << "{\n  \"warmup\": " << opts.warmup << ",\n  \"reps\": " << opts.reps
+			<< ",\n  \"optimize\": " << (opts.optimize ? "true" : "false")
+			<< ",\n  \"bytecode\": " << (opts.bytecode ? "true" : "false")
+			<< ",\n  \"parse_only\": " << (opts.parse_only ? "true" : "false")
+			<< ",\n  \"results\": [";
+		for (size_t i = 0; i < results.size(); ++i)
+		{
+			const auto &r = results[i];
+			os << (i ? ",\n" : "\n")
+				<< "    { \"name\": \"" << r.name << "\""
+				<< ", \"ops\": " << r.ops
+				<< ", \"median_ms\": " << r.median()
+				<< ", \"p95_ms\": " << r.percentile(0.95)
+				<< ", \"min_ms\": " << r.samples.front()
+				<< ", \"mean_ms\": " << r.mean()
+				<< ", \"ops_per_sec\": " << r.ops_per_sec() << " }";
+		}
+		os << "\n  ]\n}\n";
+	}
+
+	void write_csv(std::ostream &os, const std::vector<result> &results)
+	{
+		os << std::setprecision(6) << std::fixed;
+		os << "name,ops,median_ms,p95_ms,min_ms,mean_ms,ops_per_sec\n";
+		for (const auto &r : results)
+		{
+			os << r.name << "," << r.ops << "," << r.median() << "," << r.percentile(0.95) << ","
+				<< r.samples.front() << "," << r.mean() << "," << r.ops_per_sec() << "\n";
+		}
+	}
+
+	bool parse_args(int argc, const char **argv, options &opts)
+	{
+		for (int i = 1; i < argc; ++i)
+		{
+			const std::string arg(argv[i]);
+			const bool has_value = i + 1 < argc;
+			if (arg == "--warmup" && has_value)
+				opts.warmup = std::stoul(argv[++i]);
+			else if (arg == "--reps" && has_value)
+				opts.reps = std::max<size_t>(1, std::stoul(argv[++i]));
+			else if (arg == "--filter" && has_value)
+				opts.filter = argv[++i];
+			else if (arg == "--format" && has_value)
+				opts.format = argv[++i];
+			else if (arg == "--out" && has_value)
+				opts.out = argv[++i];
+			else if (arg == "--no-optimize")
+				opts.optimize = false;
+			else if (arg == "--tree")
+				opts.bytecode = false;
+			else if (arg == "--parse")
+				opts.parse_only = true;
+			else if (arg.rfind("--", 0) == 0)
+				return false;
+			else
+				opts.corpus = arg;
+		}
+		return opts.format == "text" || opts.format == "json" || opts.format == "csv";
+	}
+}
+
+int main(int argc, const char **argv)
+{
+	options opts;
+	if (!parse_args(argc, argv, opts))
+	{
+		print_help();
+		return -1;
+	}
+	if (!std::filesystem::is_directory(opts.corpus))
+	{
+		std::cerr << "cannot find corpus directory '" << opts.corpus.string() << "'" << std::endl;
+		return -1;
+	}
+
+	std::vector<result> results;
+	for (const auto &b : load_corpus(opts))
+	{
+		try
+		{
+			results.push_back(measure(b, opts));
+			std::cerr << "ran " << b.name << std::endl;
+		}
+		catch (const std::exception &e)
+		{
+			std::cerr << b.name << " failed - " << e.what() << std::endl;
+			return -1;
+		}
+	}
+
+	std::ofstream file;
+	if (!opts.out.empty())
+		file.open(opts.out);
+	std::ostream &os = opts.out.empty() ? std::cout : file;
+
+	if (opts.format == "json")
+		write_json(os, results, opts);
+	else if (opts.format == "csv")
+		write_csv(os, results);
+	else
+		write_text(os, results);
+	return 0;
+}
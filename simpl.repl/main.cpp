@@ -2,6 +2,7 @@
 #include <fstream>
 #include <chrono>
 #include <iostream>
+#include <memory>
 #include <sstream>
 
 #define SIMPL_DEFINES
@@ -121,12 +122,15 @@ int run_interpreter(InStream &s)
 	return 0;
 }
 
-int run_string(const std::string &s)
+// runs each statement as the parser hands it over.
+template <typename ParserT>
+int run_parser(ParserT &parser, bool optimize, simpl::profiler *profiler = nullptr)
 {
 	try
 	{
 		simpl::engine e;
-		simpl::parser parser(s.c_str(), s.c_str() + s.length());
+		e.context().use_optimizer(optimize);
+		e.machine().profile(profiler);
 		while (1)
 		{
 			auto nxt = parser.next();
@@ -153,25 +157,136 @@ int run_string(const std::string &s)
 	return 0;
 }
 
+int run_source(const simpl::source_buffer &source, bool optimize, simpl::profiler *profiler)
+{
+	simpl::parser parser(source.begin(), source.end());
+	return run_parser(parser, optimize, profiler);
+}
+
+// the table to stdout, the folded stacks to a file when one's given.
+void report_profile(simpl::profiler &profiler, const std::string &folded)
+{
+	profiler.stop();
+	std::cout << "\r\n\r\n";
+	profiler.write_table(std::cout);
+	if (folded.empty())
+		return;
+	std::ofstream out(folded);
+	if (!out)
+	{
+		std::cout << "cannot write '" << folded << "'" << std::endl;
+		return;
+	}
+	profiler.write_folded(out);
+}
+
+int dump_ast(const simpl::source_buffer &source, bool optimize)
+{
+	try
+	{
+		auto ast = simpl::parse(source);
+		if (optimize)
+			simpl::optimize(ast);
+		simpl::dump(std::cout, ast);
+	}
+	catch (const std::exception &e)
+	{
+		std::cout << "failed to parse - " << e.what() << std::endl;
+		return -1;
+	}
+	return 0;
+}
+
+// prints each statement as it's read, optimized on its own as it would be
+// when run.
+int dump_ast(simpl::stream_parser &parser, bool optimize)
+{
+	try
+	{
+		simpl::ast_printer printer(std::cout);
+		for (auto stmt = parser.next(); stmt; stmt = parser.next())
+		{
+			if (optimize)
+				simpl::optimize(stmt);
+			printer.print(stmt);
+			std::cout.flush();
+		}
+		std::cout << "\n";
+	}
+	catch (const std::exception &e)
+	{
+		std::cout << "failed to parse - " << e.what() << std::endl;
+		return -1;
+	}
+	return 0;
+}
+
+// simpl.repl [--dump-ast] [--no-optimize] [--profile[=folded]] [file | -]
+// '-' runs statements from stdin as they arrive. --profile prints where the
+// script spent its time, and writes flamegraph stacks to folded if given.
 int main(int argc, const char **argv)
 {
-	if (argc > 1)
+	bool dump = false;
+	bool optimize = true;
+	bool profile = false;
+	std::string folded;
+	std::string file;
+	for (int i = 1; i < argc; ++i)
 	{
-		const std::string file(argv[1]);
-		auto fs = std::ifstream(file);
-		if (!fs.good())
+		const std::string arg(argv[i]);
+		if (arg == "--dump-ast")
+			dump = true;
+		else if (arg == "--no-optimize")
+			optimize = false;
+		else if (arg == "--profile")
+			profile = true;
+		else if (arg.rfind("--profile=", 0) == 0)
+		{
+			profile = true;
+			folded = arg.substr(10);
+		}
+		else
+			file = arg;
+	}
+
+	if (file == "-")
+	{
+		simpl::stream_parser parser(std::cin);
+		if (dump)
+			return dump_ast(parser, optimize);
+		if (!profile)
+			return run_parser(parser, optimize);
+		simpl::profiler profiler;
+		run_parser(parser, optimize, &profiler);
+		report_profile(profiler, folded);
+		return 0;
+	}
+	else if (!file.empty())
+	{
+		simpl::source_buffer source;
+		try
+		{
+			source = simpl::source_buffer::map(file);
+		}
+		catch (const std::exception &)
 		{
 			std::cout << "cannot open file" << std::endl;
 			return -1;
 		}
-		std::string str((std::istreambuf_iterator<char>(fs)), std::istreambuf_iterator<char>());
+		if (dump)
+			return dump_ast(source, optimize);
+		std::unique_ptr<simpl::profiler> profiler;
+		if (profile)
+			profiler = std::make_unique<simpl::profiler>();
 		std::chrono::time_point now = std::chrono::high_resolution_clock::now();
-		run_string(str);
+		run_source(source, optimize, profiler.get());
 		auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::high_resolution_clock::now() - now).count();
 		std::cout << "\r\n\r\nelapsed: " << elapsed << " ms.";
+		if (profiler)
+			report_profile(*profiler, folded);
 	}
 	else
 	{
 		return run_interpreter(std::cin);
 	}
-}
\ No newline at end of file
+}
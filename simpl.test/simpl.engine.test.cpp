@@ -4,8 +4,15 @@
 #include <simpl/simpl.h>
 
 #include <array>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
 #include <functional>
 #include <optional>
+#include <sstream>
+#include <thread>
 
 using namespace Microsoft::VisualStudio::CppUnitTestFramework;
 
@@ -17,6 +24,7 @@ namespace simpl_test
 		simpl::engine e;
 		std::function<void()> trap;
 		std::function<void(const simpl::value_t&)> check;
+		std::optional<simpl::value_t> last;
 
 	public:
 		simpl_engine_test()
@@ -151,8 +159,8 @@ namespace simpl_test
 			check = [&](const simpl::value_t& v)
 			{
 				++calls;
-				Assert::IsTrue(std::holds_alternative<std::string>(v));
-				const auto value = std::get<std::string>(v);
+				Assert::IsTrue(simpl::holds<std::string>(v));
+				const auto value = simpl::get<std::string>(v);
 				if (calls == 1)
 				{
 					Assert::AreEqual(std::string{ "seed" }, value);
@@ -228,8 +236,8 @@ namespace simpl_test
 			check = [&](const simpl::value_t& v)
 			{
 				called = true;
-				Assert::IsTrue(std::holds_alternative<simpl::number>(v));
-				Assert::AreEqual(1.00, std::get<simpl::number>(v));
+				Assert::IsTrue(simpl::holds<simpl::number>(v));
+				Assert::AreEqual(1.00, simpl::get<simpl::number>(v));
 			};
 			auto ast = simpl::parse("let i =0; i++; assert(i);");
 			simpl::evaluate(ast, e);
@@ -242,8 +250,8 @@ namespace simpl_test
 			check = [&](const simpl::value_t& v)
 			{
 				called = true;
-				Assert::IsTrue(std::holds_alternative<simpl::number>(v));
-				Assert::AreEqual(2.00, std::get<simpl::number>(v));
+				Assert::IsTrue(simpl::holds<simpl::number>(v));
+				Assert::AreEqual(2.00, simpl::get<simpl::number>(v));
 				
 			};
 			auto ast = simpl::parse("let j=0; let i =2; j=i++; assert(j);");
@@ -257,8 +265,8 @@ namespace simpl_test
 			check = [&](const simpl::value_t& v)
 			{
 				called = true;
-				Assert::IsTrue(std::holds_alternative<simpl::number>(v));
-				Assert::AreEqual(-1.00, std::get<simpl::number>(v));
+				Assert::IsTrue(simpl::holds<simpl::number>(v));
+				Assert::AreEqual(-1.00, simpl::get<simpl::number>(v));
 			};
 			auto ast = simpl::parse("let i =0; i--; assert(i);");
 			simpl::evaluate(ast, e);
@@ -271,8 +279,8 @@ namespace simpl_test
 			check = [&](const simpl::value_t& v)
 			{
 				called = true;
-				Assert::IsTrue(std::holds_alternative<simpl::number>(v));
-				Assert::AreEqual(1.00, std::get<simpl::number>(v));
+				Assert::IsTrue(simpl::holds<simpl::number>(v));
+				Assert::AreEqual(1.00, simpl::get<simpl::number>(v));
 			};
 			auto ast = simpl::parse("let i =0; ++i; assert(i);");
 			simpl::evaluate(ast, e);
@@ -285,8 +293,8 @@ namespace simpl_test
 			check = [&](const simpl::value_t& v)
 			{
 				called = true;
-				Assert::IsTrue(std::holds_alternative<simpl::number>(v));
-				Assert::AreEqual(-1.00, std::get<simpl::number>(v));
+				Assert::IsTrue(simpl::holds<simpl::number>(v));
+				Assert::AreEqual(-1.00, simpl::get<simpl::number>(v));
 			};
 			auto ast = simpl::parse("let i=0; --i; assert(i);");
 			simpl::evaluate(ast, e);
@@ -370,8 +378,8 @@ namespace simpl_test
 		{
 			check = [](const simpl::value_t& v)
 			{
-				Assert::IsTrue(std::holds_alternative<simpl::number>(v));
-				Assert::AreEqual((simpl::number)2.00, std::get<simpl::number>(v));
+				Assert::IsTrue(simpl::holds<simpl::number>(v));
+				Assert::AreEqual((simpl::number)2.00, simpl::get<simpl::number>(v));
 			};
 
 			run("let arr = new [ \"item\", 1, new {}]; ++arr[1]; assert(arr[1]);");
@@ -408,11 +416,578 @@ namespace simpl_test
 			});
 		}
 
+		TEST_METHOD(TestReturnFromLoop)
+		{
+			const auto value = run_value("def find() { let i = 0; while(i < 10) { if(i == 7) { return i; } ++i; } return 0; } assert(find());");
+			Assert::AreEqual(7.0, simpl::get<simpl::number>(value));
+			Assert::AreEqual(size_t{ 1 }, e.machine().callstack().size());
+			Assert::AreEqual(size_t{ 1 }, e.machine().scopes().size());
+			Assert::AreEqual(size_t{ 0 }, e.machine().stack().size());
+		}
+
+		TEST_METHOD(TestRecursiveCall)
+		{
+			const auto value = run_value("def fib(n) { if(n < 2) { return n; } return fib(n - 1) + fib(n - 2); } assert(fib(15));");
+			Assert::AreEqual(610.0, simpl::get<simpl::number>(value));
+			Assert::AreEqual(size_t{ 0 }, e.machine().stack().size());
+		}
+
+		TEST_METHOD(TestForLoopCleansUp)
+		{
+			Assert::AreEqual(10.0, simpl::get<simpl::number>(run_value("let sum = 0; for(let i = 0; i < 5; ++i) { sum = sum + i; } assert(sum);")));
+			Assert::AreEqual(size_t{ 1 }, e.machine().scopes().size());
+			Assert::AreEqual(size_t{ 1 }, e.machine().stack().size()); // sum
+		}
+
+		TEST_METHOD(TestTreeWalkFallback)
+		{
+			e.context().use_bytecode(false);
+			Assert::AreEqual(3.0, simpl::get<simpl::number>(run_value("def add(a, b) { return a + b; } assert(add(1, 2));")));
+			e.context().use_bytecode(true);
+			Assert::AreEqual(5.0, simpl::get<simpl::number>(run_value("assert(add(2, 3));")));
+		}
+
+		TEST_METHOD(TestCallerLocalHidesGlobal)
+		{
+			run("let g = 1; def read() { return g; } def hide() { let g = 5; return read(); }");
+			Assert::AreEqual(1.0, simpl::get<simpl::number>(run_value("assert(read());")));
+			Assert::AreEqual(5.0, simpl::get<simpl::number>(run_value("assert(hide());")));
+		}
+
+		TEST_METHOD(TestIndexByLocal)
+		{
+			Assert::AreEqual(4.0, simpl::get<simpl::number>(run_value("def last(arr) { let i = 2; arr[i] = arr[i] + 1; return arr[i]; } assert(last(new [1, 2, 3]));")));
+		}
+
+		TEST_METHOD(TestCallSiteSeesNewOverload)
+		{
+			run("def f(a) { return \"any\"; } def g(x) { return f(x); }");
+			Assert::AreEqual(std::string{ "any" }, simpl::get<std::string>(run_value("assert(g(1));")));
+			run("def f(a is number) { return \"number\"; }");
+			Assert::AreEqual(std::string{ "number" }, simpl::get<std::string>(run_value("assert(g(1));")));
+			Assert::AreEqual(std::string{ "any" }, simpl::get<std::string>(run_value("assert(g(\"s\"));")));
+		}
+
+		TEST_METHOD(TestInheritedDispatch)
+		{
+			run("object vehicle { wheels; } object car inherits vehicle { } object bike inherits vehicle { }");
+			run("def kind(v is vehicle) { return \"vehicle\"; } def kind(c is car) { return \"car\"; }");
+			Assert::AreEqual(std::string{ "car" }, simpl::get<std::string>(run_value("assert(kind(new car { }));")));
+			Assert::AreEqual(std::string{ "vehicle" }, simpl::get<std::string>(run_value("assert(kind(new bike { }));")));
+			Assert::IsTrue(e.machine().lookup_type("car")->lineage.size() == 2);
+		}
+
+		TEST_METHOD(TestDeepRecursion)
+		{
+			Assert::AreEqual(1000.0, simpl::get<simpl::number>(run_value("def count(n) { if(n == 0) { return 0; } return 1 + count(n - 1); } assert(count(1000));")));
+			Assert::IsTrue(e.machine().stack().high_water() > 1000);
+			Assert::AreEqual(size_t{ 0 }, e.machine().stack().size());
+		}
+
+		TEST_METHOD(TestStackLimit)
+		{
+			simpl::engine limited{ simpl::vm_limits{ 64, 64, 16 } };
+			auto ast = simpl::parse("def forever(n) { return 1 + forever(n + 1); } forever(0);");
+			Assert::ExpectException<std::runtime_error>([&]()
+			{
+				simpl::evaluate(ast, limited);
+			});
+			Assert::AreEqual(size_t{ 1 }, limited.machine().callstack().size());
+		}
+
+		TEST_METHOD(TestTreeWalkStackLimit)
+		{
+			// the tree walker recurses natively, it stops well short of the call limit.
+			e.context().use_bytecode(false);
+			run("def count(n) { if(n == 0) { return 0; } return 1 + count(n - 1); }");
+			Assert::AreEqual(100.0, simpl::get<simpl::number>(run_value("assert(count(100));")));
+			Assert::ExpectException<std::runtime_error>([&]() { run("count(3000);"); });
+			Assert::AreEqual(size_t{ 1 }, e.machine().callstack().size());
+			Assert::AreEqual(size_t{ 1 }, e.machine().scopes().size());
+			Assert::AreEqual(100.0, simpl::get<simpl::number>(run_value("assert(count(100));")));
+		}
+
+		TEST_METHOD(TestOperandKernels)
+		{
+			Assert::AreEqual(5.0, simpl::get<simpl::number>(simpl::apply<simpl::add_op>(2.0, 3.0)));
+			Assert::AreEqual(std::string{ "ab" }, simpl::get<std::string>(simpl::apply<simpl::add_op>(std::string{ "a" }, std::string{ "b" })));
+			Assert::AreEqual(std::string{ "a1" }, simpl::get<std::string>(simpl::apply<simpl::add_op>(std::string{ "a" }, 1.0)));
+			Assert::AreEqual(3.0, simpl::get<simpl::number>(simpl::apply<simpl::add_op>(2.0, std::string{ "1" })));
+			Assert::IsTrue(simpl::get<bool>(simpl::apply<simpl::lt_op>(std::string{ "a" }, std::string{ "b" })));
+			Assert::IsTrue(simpl::get<bool>(simpl::apply<simpl::eqeq_op>(simpl::value_t{}, simpl::value_t{})));
+			Assert::ExpectException<simpl::invalid_operation>([]()
+			{
+				simpl::apply<simpl::sub_op>(std::string{ "a" }, std::string{ "b" });
+			});
+		}
+
+		TEST_METHOD(TestNanBoxing)
+		{
+			using boxed = simpl::detail::nan_box<simpl::empty_t, simpl::blobref_t, simpl::arrayref_t, simpl::objectref_t>;
+			Assert::AreEqual(size_t{ 8 }, sizeof(boxed));
+			Assert::AreEqual(size_t{ boxed::empty_index }, boxed{}.index());
+			Assert::IsTrue(boxed{ true }.get<bool>());
+			Assert::IsFalse(boxed{ false }.get<bool>());
+			Assert::AreEqual(-2.5, boxed{ -2.5 }.get<double>());
+
+			// a NaN of any sign or payload is stored as a number, not a boxed tag.
+			volatile double zero = 0.0;
+			boxed d{ 1.0 };
+			d = boxed{ d.get<double>() * zero / zero };
+			Assert::AreEqual(size_t{ boxed::number_index }, d.index());
+			Assert::IsTrue(std::isnan(d.get<double>()));
+			Assert::AreEqual(size_t{ boxed::number_index }, boxed{ -std::numeric_limits<double>::quiet_NaN() }.index());
+
+			// strings are shared until one copy is written.
+			boxed a{ std::string{ "hi" } };
+			boxed b = a;
+			Assert::IsTrue(&std::as_const(a).get<std::string>() == &std::as_const(b).get<std::string>());
+			b.get<std::string>().append("!");
+			Assert::AreEqual(std::string{ "hi" }, std::as_const(a).get<std::string>());
+			Assert::AreEqual(std::string{ "hi!" }, std::as_const(b).get<std::string>());
+
+			// and through value_t, however it's built.
+			simpl::value_t v{ 1.0 };
+			v = simpl::value_t{ simpl::get<double>(v) * zero / zero };
+			Assert::IsTrue(simpl::holds<double>(v));
+		}
+
+		TEST_METHOD(TestOptimizerFoldsAndPrunes)
+		{
+			auto ast = simpl::parse("let a = 2; let b = a * 3 + 1; if (b == 7) { assert(b); } else { assert(0); }");
+			simpl::optimize(ast);
+			std::stringstream ss;
+			simpl::dump(ss, ast);
+			Assert::AreEqual(std::string{ "(let a 2)\n(let b 7)\n(if true\n  (block\n    (expr (call assert 7))))\n" }, ss.str());
+
+			Assert::AreEqual(7.0, simpl::get<simpl::number>(run_value(ast, e)));
+		}
+
+		TEST_METHOD(TestOptimizerStopsAtCalls)
+		{
+			Assert::AreEqual(3.0, simpl::get<simpl::number>(run_value("def bump() { a = a + 1; } let a = 1; bump(); assert(a + 1);")));
+			Assert::AreEqual(3.0, simpl::get<simpl::number>(run_value("let i = 0; while (i < 3) { i++; } assert(i);")));
+		}
+
+		TEST_METHOD(TestObjectShapes)
+		{
+			run("object point { x = 1; y; } object point3 inherits point { y = 2; z = 3; }");
+			run("def sum(p) { return p.x + p.y + p.z; }");
+			run("let a = new point3 { }; let b = new point3 { w = 4 }; b.z = 10;");
+			Assert::AreEqual(23.0, simpl::get<simpl::number>(run_value("assert(sum(a) + sum(b) + b.w);")));
+
+			const auto point = e.machine().lookup_type("point");
+			const auto point3 = e.machine().lookup_type("point3");
+			Assert::AreEqual(size_t{ 3 }, point3->layout->size());
+			Assert::AreEqual(point->layout->slot("y"), point3->layout->slot("y"));
+
+			Assert::ExpectException<std::runtime_error>([&]()
+			{
+				run("object point4 inherits point3 { z; }");
+			});
+
+			// a caller's local of the member's name indexes, even at a warm site.
+			run("def getx(p) { return p.x; } def hidex() { let x = 0; return getx(new point { }); }");
+			Assert::AreEqual(1.0, simpl::get<simpl::number>(run_value("assert(getx(new point { }));")));
+			Assert::ExpectException<std::runtime_error>([&]() { run("hidex();"); });
+			Assert::AreEqual(1.0, simpl::get<simpl::number>(run_value("assert(getx(new point { }));")));
+		}
+
+		TEST_METHOD(TestBlobMembers)
+		{
+			run("def get(b) { return b.a; } let p = new { a = 1, b = 2 }; let q = new { b = 3, a = 4 };");
+			Assert::AreEqual(7.0, simpl::get<simpl::number>(run_value("q.a = q.a + 1; assert(get(p) + get(q) + get(p));")));
+			Assert::AreEqual(std::string{ "{ a : 5, b : 3 }" }, simpl::cast<std::string>(run_value("assert(q);")));
+			Assert::ExpectException<std::runtime_error>([&]() { run("def hide() { let a = 0; return get(new { a = 2 }); } hide();"); });
+
+			simpl::blob_t blob;
+			for (int i = 0; i < 40; ++i)
+				blob.values["k" + std::to_string(i)] = simpl::number{ (double)i };
+			Assert::AreEqual(size_t{ 40 }, blob.values.size());
+			Assert::AreEqual(17.0, simpl::get<simpl::number>(blob.values.at("k17")));
+			Assert::IsTrue(blob.values.find("k40") == blob.values.end());
+			Assert::AreEqual(std::string{ "k39" }, blob.values.entry(39).first.str());
+		}
+
+		TEST_METHOD(TestParseArena)
+		{
+			auto ast = simpl::parse("let a = 1; def f(x) { return x + a; }");
+			const auto arena = simpl::detail::node_arena::owner(ast[0].get());
+			Assert::IsNotNull(arena);
+			Assert::IsTrue(arena == simpl::detail::node_arena::owner(ast[1].get()));
+			Assert::IsNull(simpl::detail::node_arena::owner(std::make_unique<simpl::expression>().get()));
+
+			// f's body outlives the tree it was parsed in.
+			simpl::evaluate(ast, e);
+			ast.clear();
+			Assert::AreEqual(3.0, simpl::get<simpl::number>(run_value("assert(f(2));")));
+		}
+
+		TEST_METHOD(TestSourceBuffers)
+		{
+			const std::string script = "let a = 1; if (a == 2) { a = 5; } else { a = 3; } # done\nlet s = \"a long literal\"; let t = a;";
+
+			// chunks of 7 split statements, the literal and the if from its else.
+			std::istringstream is(script);
+			simpl::stream_parser sp(is, 7);
+			size_t count = 0;
+			for (auto stmt = sp.next(); stmt; stmt = sp.next(), ++count)
+				simpl::evaluate(std::move(stmt), e);
+			Assert::AreEqual(size_t{ 4 }, count);
+			Assert::AreEqual(3.0, simpl::get<simpl::number>(run_value("assert(t);")));
+
+			const auto path = std::filesystem::temp_directory_path() / "simpl_source_test.sl";
+			std::ofstream(path) << script;
+			{
+				auto source = simpl::source_buffer::map(path);
+				Assert::IsTrue(source.view() == script);
+				Assert::AreEqual(size_t{ 4 }, simpl::parse(source).size());
+			}
+			std::filesystem::remove(path);
+
+			// read a line at a time, blank ones and a last one with no newline too.
+			std::istringstream lines("let c = 1;\n\n\nlet d = c + 1;");
+			simpl::stream_parser line_parser(lines);
+			for (auto stmt = line_parser.next(); stmt; stmt = line_parser.next())
+				simpl::evaluate(std::move(stmt), e);
+			Assert::AreEqual(2.0, simpl::get<simpl::number>(run_value("assert(d);")));
+
+			std::istringstream bad("let b = 1;\nlet = 2;");
+			simpl::stream_parser bad_parser(bad, 4);
+			bad_parser.next();
+			Assert::ExpectException<simpl::parse_error>([&]() { bad_parser.next(); });
+		}
+
+		TEST_METHOD(TestStreamedLongStatement)
+		{
+			// hands over a line per read, with nothing more ready, as a pipe does.
+			struct line_buf : std::streambuf
+			{
+				explicit line_buf(std::string text) :text_(std::move(text)), next_(0) {}
+
+				int_type underflow() override
+				{
+					if (next_ == text_.size())
+						return traits_type::eof();
+					auto end = text_.find('\n', next_);
+					end = end == std::string::npos ? text_.size() : end + 1;
+					setg(&text_[next_], &text_[next_], &text_[0] + end);
+					next_ = end;
+					return traits_type::to_int_type(*gptr());
+				}
+
+				std::string text_;
+				size_t next_;
+			};
+
+			auto parse = [](size_t lines)
+			{
+				std::string script = "def long() {\n";
+				for (size_t i = 0; i < lines; ++i)
+					script += "  let v" + std::to_string(i) + " = " + std::to_string(i) + ";\n";
+				script += "  return v" + std::to_string(lines - 1) + ";\n}\nlet r = long();\n";
+
+				line_buf buf(std::move(script));
+				std::istream is(&buf);
+				simpl::stream_parser sp(is);
+				const auto start = std::chrono::steady_clock::now();
+				size_t count = 0;
+				for (auto stmt = sp.next(); stmt; stmt = sp.next())
+					++count;
+				Assert::AreEqual(size_t{ 2 }, count);
+				return std::chrono::steady_clock::now() - start;
+			};
+
+			// parsing the def again after every line takes minutes at this size.
+			Assert::IsTrue(parse(16000) < std::chrono::seconds(2));
+
+			// a statement split across lines still comes out whole.
+			line_buf buf("let w = 1;\nif (w == 1)\n{\n  w = 2;\n}\nelse\n{\n  w = 3;\n}\n");
+			std::istream is(&buf);
+			simpl::stream_parser sp(is);
+			for (auto stmt = sp.next(); stmt; stmt = sp.next())
+				simpl::evaluate(std::move(stmt), e);
+			Assert::AreEqual(2.0, simpl::get<simpl::number>(run_value("assert(w);")));
+		}
+
+		TEST_METHOD(TestModuleCache)
+		{
+			const auto dir = std::filesystem::temp_directory_path() / "simpl_module_cache_test";
+			std::filesystem::remove_all(dir);
+			std::filesystem::create_directories(dir);
+			const auto module = dir / "cached_module.sl";
+			std::ofstream(module) << "object point { x = 1; y; }\n"
+				"def scale(p is point, n) { if (n == 0) { return 0; } else if (n == 1) { return p.x; } else { return p.x * n; } }\n"
+				"let cached = new { a = \"s\", b = new [1, 2] };";
+
+			// the tree read back prints the same as the one parsed.
+			auto source = simpl::source_buffer::map(module);
+			auto print = [](const simpl::syntax_tree& ast)
+			{
+				std::ostringstream os;
+				simpl::ast_printer printer(os);
+				for (const auto& stmt : ast)
+					printer.print(stmt);
+				return os.str();
+			};
+			Assert::AreEqual(print(simpl::parse(source)), print(simpl::ast_reader::read(simpl::ast_writer::write(simpl::parse(source)))));
+
+			// the first import caches, the second loads it, a torn file parses again.
+			std::optional<simpl::value_t> value;
+			simpl::module_cache cache(dir / "cache");
+			const auto cwd = std::filesystem::current_path();
+			std::filesystem::current_path(dir);
+			for (int i = 0; i < 3; ++i)
+			{
+				simpl::engine engine;
+				engine.context().use_module_cache(cache.directory());
+				engine.machine().reg_fn("check", [&](const simpl::value_t& v) { value = v; });
+				auto ast = simpl::parse("@import cached_module.sl check(scale(new point{ x = 4 }, 3));");
+				simpl::evaluate(ast, engine);
+				Assert::AreEqual(12.0, simpl::get<simpl::number>(*value));
+				Assert::IsTrue(cache.find(source).has_value());
+				if (i == 1)
+					std::filesystem::resize_file(cache.path_for(source), 20);
+			}
+			std::filesystem::current_path(cwd);
+			std::filesystem::remove_all(dir);
+		}
+
+		TEST_METHOD(TestEngineClone)
+		{
+			run("@import array object counter { n = 0; } "
+				"let c = new counter{}; let items = new [1, 2]; let same = items; "
+				"def bump(x is counter) { x.n = x.n + 1; return x.n; } "
+				"def total() { return items[0] + items[1] + c.n; }");
+
+			simpl::engine copy(e);
+			auto ast = simpl::parse("bump(c); push(items, 5); items[0] = 10; assert(total() + size(same)); def extra() { return 1; }");
+			Assert::AreEqual(16.0, simpl::get<simpl::number>(run_value(ast, copy)));
+
+			// the template's values and functions are as they were.
+			Assert::AreEqual(5.0, simpl::get<simpl::number>(run_value("assert(total() + size(items));")));
+			Assert::IsFalse(e.machine().can_invoke("extra"));
+			Assert::IsTrue(copy.machine().can_invoke("extra"));
+		}
+
+		TEST_METHOD(TestEnginePool)
+		{
+			simpl::engine setup;
+			auto ast = simpl::parse("@import array let base = new [1, 2]; def fib(n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); }");
+			simpl::evaluate(ast, setup);
+			simpl::engine_pool pool(std::make_shared<const simpl::program>(setup), 2);
+
+			// every lease starts from the program's values, whichever thread.
+			std::atomic<int> good{ 0 };
+			std::vector<std::thread> workers;
+			for (int t = 0; t < 4; ++t)
+			{
+				workers.emplace_back([&]()
+				{
+					for (int i = 0; i < 25; ++i)
+					{
+						auto e = pool.acquire();
+						auto request = simpl::parse("push(base, fib(10)); let r = size(base) + base[2];");
+						simpl::evaluate(request, *e);
+						if (simpl::get<simpl::number>(e->machine().load_var("r")) == 58.0)
+							++good;
+					}
+				});
+			}
+			for (auto& w : workers)
+				w.join();
+			Assert::AreEqual(100, good.load());
+			Assert::AreEqual(size_t{ 2 }, pool.ready());
+		}
+
+		TEST_METHOD(TestTailCalls)
+		{
+			// well past the 16 calls the vm allows.
+			simpl::engine limited{ simpl::vm_limits{ 64, 64, 16 } };
+			std::optional<simpl::value_t> value;
+			limited.machine().reg_fn("assert", [&](const simpl::value_t &v) { value = v; });
+			auto ast = simpl::parse(
+				"def sum(n, acc) { if (n == 0) { return acc; } return sum(n - 1, acc + n); } "
+				"def odd(n) { if (n == 0) { return 0; } return even(n - 1); } "
+				"def even(n) { if (n == 0) { return 1; } return odd(n - 1); } "
+				"assert(sum(10000, 0) + even(1001));");
+			simpl::evaluate(ast, limited);
+			Assert::AreEqual(50005000.0, simpl::get<simpl::number>(*value));
+			Assert::AreEqual(size_t{ 1 }, limited.machine().callstack().size());
+			Assert::AreEqual(size_t{ 0 }, limited.machine().stack().size());
+		}
+
+		TEST_METHOD(TestProfiler)
+		{
+			simpl::profiler profiler(std::chrono::microseconds(100));
+			e.machine().profile(&profiler);
+			run("def fib(n) { if (n < 2) { return n; } return fib(n - 1) + fib(n - 2); } "
+				"def work() { let t = 0; for (let i = 0; i < 5; ++i) { t = t + fib(18); } return t; } work();");
+			e.machine().profile(nullptr);
+			profiler.stop();
+
+			Assert::IsTrue(profiler.ticks() > 0);
+			std::stringstream folded;
+			profiler.write_folded(folded);
+			std::string line;
+			while (std::getline(folded, line))
+				Assert::IsTrue(line.rfind("main;work", 0) == 0);
+
+			const auto table = profiler.table();
+			Assert::AreEqual(std::string{ "fib" }, table.front().function);
+			for (const auto &entry : table)
+				Assert::IsTrue(entry.self <= entry.total && entry.total <= profiler.ticks());
+		}
+
+		TEST_METHOD(TestStats)
+		{
+			const auto value = run_value("@import stats def wrap(x) { return new [x]; } wrap(1); wrap(2); assert(stats());");
+			auto &counts = simpl::get<simpl::blobref_t>(value)->values;
+			const auto s = e.machine().stats();
+			Assert::IsTrue(s.stack_high_water > 0 && s.scope_high_water > 1);
+			Assert::AreEqual(static_cast<double>(s.stack_high_water), simpl::get<simpl::number>(counts["stack_high_water"]));
+			if constexpr (simpl::vm_stats::enabled)
+			{
+				Assert::AreEqual(1.0, simpl::get<simpl::number>(counts["enabled"]));
+				Assert::AreEqual(2.0, simpl::get<simpl::number>(counts["arrays"]));
+				Assert::AreEqual(1.0, simpl::get<simpl::number>(counts["imports"]));
+				Assert::IsTrue(s.calls >= 3 && s.exact_lookups + s.candidate_lookups >= 3);
+			}
+			else
+			{
+				Assert::AreEqual(0.0, simpl::get<simpl::number>(counts["enabled"]));
+				Assert::AreEqual(0.0, simpl::get<simpl::number>(counts["calls"]));
+				Assert::IsTrue(s.calls == 0 && s.exact_lookups == 0);
+			}
+		}
+
+		TEST_METHOD(TestWorkBudget)
+		{
+			run("let n = 0; def spin() { while (1) { n = n + 1; } }");
+			for (const bool bytecode : { true, false })
+			{
+				e.context().use_bytecode(bytecode);
+				e.machine().set_budget(simpl::work_budget{ 1000 });
+				Assert::ExpectException<simpl::budget_exceeded>([&]() { run("spin();"); });
+				Assert::ExpectException<simpl::budget_exceeded>([&]() { run("spin();"); });
+
+				e.machine().set_budget(simpl::work_budget{ 0, std::chrono::steady_clock::now() + std::chrono::milliseconds(10) });
+				Assert::ExpectException<simpl::budget_exceeded>([&]() { run("for (let i = 0; 1; ++i) { n = i; }"); });
+				Assert::AreEqual(size_t{ 1 }, e.machine().callstack().size());
+				Assert::AreEqual(size_t{ 1 }, e.machine().scopes().size());
+
+				e.machine().clear_budget();
+				Assert::AreEqual(5000.0, simpl::get<simpl::number>(run_value("n = 0; for (let i = 0; i < 5000; ++i) { n = n + 1; } assert(n);")));
+			}
+
+			// pmap's workers share the caller's operations, however many cores.
+			run("@import array let big = new []; for (let i = 0; i < 4096; ++i) { push(big, i); } def sq(x) { return x * x; }");
+			e.machine().set_budget(simpl::work_budget{ 1000 });
+			Assert::ExpectException<simpl::budget_exceeded>([&]() { run("pmap(big, &sq);"); });
+			Assert::ExpectException<simpl::budget_exceeded>([&]() { run("spin();"); });
+
+			e.machine().set_budget(simpl::work_budget{ 10000 });
+			run("pmap(big, &sq);");
+			Assert::IsTrue(e.machine().spent() > 4096);
+			e.machine().clear_budget();
+		}
+
+		TEST_METHOD(TestGenerators)
+		{
+			std::vector<double> values;
+			check = [&](const simpl::value_t& v)
+			{
+				if (simpl::holds<simpl::empty_t>(v))
+					values.push_back(-1);
+				else if (simpl::holds<bool>(v))
+					values.push_back(simpl::get<bool>(v) ? 1 : 0);
+				else
+					values.push_back(simpl::get<simpl::number>(v));
+			};
+			run("let g = 0; def upto(n) { let i = 0; while (i < n) { yield i; ++i; } return 99; }");
+			for (const bool bytecode : { true, false })
+			{
+				e.context().use_bytecode(bytecode);
+				values.clear();
+				run("for (let x in upto(3)) { for (let y in new [10, 20]) { assert(x + y); } }");
+				Assert::IsTrue(std::vector<double>{ 10, 20, 11, 21, 12, 22 } == values);
+
+				values.clear();
+				run("g = upto(2); assert(next(g)); assert(done(g)); assert(next(g)); assert(next(g)); assert(done(g));");
+				Assert::IsTrue(std::vector<double>{ 0, 0, 1, -1, 1 } == values);
+				Assert::AreEqual(size_t{ 1 }, e.machine().callstack().size());
+				Assert::AreEqual(size_t{ 1 }, e.machine().scopes().size());
+			}
+
+			values.clear();
+			run("def squares(a) { for (let x in a) { yield x * x; } } for (let s in squares(new [1, 2, 3])) { assert(s); }");
+			Assert::IsTrue(std::vector<double>{ 1, 4, 9 } == values);
+			Assert::ExpectException<std::runtime_error>([&]() { run("for (let x in 5) { }"); });
+		}
+
+		TEST_METHOD(TestArrayFunctions)
+		{
+			std::vector<double> values;
+			check = [&](const simpl::value_t& v) { values.push_back(simpl::get<simpl::number>(v)); };
+			run("@import array let big = new []; for (let i = 0; i < 5000; ++i) { push(big, i); } let squares = 0; "
+				"def sq(x) { return x * x; } def over2(x) { return x > 2; } "
+				"def add(a, b) { return a + b; } def show(x) { assert(x); }");
+			for (const bool bytecode : { true, false })
+			{
+				e.context().use_bytecode(bytecode);
+				values.clear();
+				run("for_each(map(filter(new [1, 2, 3, 4], &over2), &sq), &show); assert(reduce(new [1, 2, 3], &add, 10));");
+				Assert::IsTrue(std::vector<double>{ 9, 16, 16 } == values);
+
+				values.clear();
+				run("squares = pmap(big, &sq); assert(size(squares)); assert(squares[4999]); "
+					"assert(preduce(big, &add, 7)); assert(preduce(new [], &add, 7));");
+				Assert::IsTrue(std::vector<double>{ 5000, 4999.0 * 4999, 5000.0 * 4999 / 2 + 7, 7 } == values);
+				Assert::AreEqual(size_t{ 1 }, e.machine().callstack().size());
+			}
+			Assert::ExpectException<std::runtime_error>([&]() { run("pmap(big, &nope);"); });
+		}
+
+		TEST_METHOD(TestSharedStrings)
+		{
+			std::vector<std::string> texts;
+			check = [&](const simpl::value_t& v)
+			{
+				texts.push_back(simpl::holds<std::string>(v) ? simpl::get<std::string>(v) : simpl::get<bool>(v) ? "true" : "false");
+			};
+			e.machine().reg_fn("shout", [](std::string& s) { s.append("!"); return s; });
+			run("def keep(s) { let t = s; t = t + \" there\"; assert(shout(t)); assert(shout(s)); return s; } "
+				"let a = \"hi\"; let b = a; let c = \"h\" + \"i\";");
+			for (const bool bytecode : { true, false })
+			{
+				e.context().use_bytecode(bytecode);
+				texts.clear();
+				run("assert(keep(b)); assert(a); assert(b); assert(a == c); assert(b != \"hi!\"); assert(a == \"ho\");");
+				Assert::IsTrue(std::vector<std::string>{ "hi there!", "hi!", "hi", "hi", "hi", "true", "true", "false" } == texts);
+			}
+		}
+
 private:
 		void run(const std::string& str)
 		{
 			auto ast = simpl::parse(str);
 			simpl::evaluate(ast, e);
 		}
+
+		// evaluates the script and returns what its last assert was passed.
+		simpl::value_t run_value(const std::string& str)
+		{
+			auto ast = simpl::parse(str);
+			return run_value(ast, e);
+		}
+
+		simpl::value_t run_value(simpl::syntax_tree& ast, simpl::engine& target)
+		{
+			last = std::nullopt;
+			check = [this](const simpl::value_t& v) { last = v; };
+			simpl::evaluate(ast, target);
+			Assert::IsTrue(last.has_value());
+			return *last;
+		}
 	};
 }
@@ -217,5 +217,47 @@ namespace simpl_test
 			Assert::AreEqual(simpl::token_types::identifier_token, t2.type);
 			Assert::AreEqual(std::string{ "i" }, t2.to_string());
 		}
+
+		TEST_METHOD(TestTokenLongestOp)
+		{
+			std::string text{ "a<=b==c!d||e|f...g..h&&" };
+			simpl::tokenizer tknzer{ text };
+			std::vector<std::string> ops;
+			for (auto t = tknzer.next(); t.type != simpl::token_types::eof; t = tknzer.next())
+			{
+				if (t.type == simpl::token_types::op)
+					ops.emplace_back(t.view());
+			}
+
+			const std::vector<std::string> expected{ "<=", "==", "!", "||", "|", "...", "..", "&&" };
+			Assert::IsTrue(expected == ops);
+			Assert::IsTrue(simpl::op_type::expand == simpl::to_op_type(text.c_str() + 14, text.c_str() + 17));
+			Assert::IsTrue(simpl::op_type::none == simpl::to_op_type(text.c_str() + 18, text.c_str() + 20));
+		}
+
+		TEST_METHOD(TestTokenLongRuns)
+		{
+			// runs longer than a block, with the ends at odd offsets.
+			const std::string blanks(45, ' '), tabs(33, '\t'), name(71, 'a');
+			const std::string body(100, 'x');
+			std::string text = blanks + name + "_Z9" + tabs + "# " + body + "\n" + "\"" + body + "\n" + body + "\"" + blanks + ";";
+			simpl::tokenizer tknzer{ text };
+
+			auto t1 = tknzer.next();
+			Assert::AreEqual(simpl::token_types::identifier_token, t1.type);
+			Assert::AreEqual(name + "_Z9", t1.to_string());
+			Assert::AreEqual(size_t{ 46 }, t1.pos.col);
+
+			auto t2 = tknzer.next();
+			Assert::AreEqual(simpl::token_types::literal, t2.type);
+			Assert::AreEqual(body + "\n" + body, t2.to_string());
+			Assert::AreEqual(size_t{ 2 }, t2.pos.line);
+			Assert::AreEqual(size_t{ 1 }, t2.pos.col);
+
+			auto t3 = tknzer.next();
+			Assert::AreEqual(simpl::token_types::eos, t3.type);
+			Assert::AreEqual(size_t{ 3 }, t3.pos.line);
+			Assert::AreEqual(size_t{ 147 }, t3.pos.col);
+		}
 	};
 }